@@ -0,0 +1,71 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "logger.hh"
+
+using namespace std;
+
+namespace {
+
+// std::ostream discarding everything, so only the formatting cost is measured
+class NullBuf final: public streambuf {
+protected:
+  int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+  streamsize xsputn(const char *, streamsize count) override { return count; }
+};
+
+template<typename F> void run(const char *name, int iterations, F f)
+{
+  const auto start = chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    f(i);
+  }
+  const auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+  cout << left << setw(40) << name << right << setw(10)
+       << static_cast<double>(elapsed.count()) / iterations << " ns/line" << endl;
+}
+
+} //namespace
+
+int main(int argc, char **argv)
+{
+  const int iterations = (argc > 1) ? stoi(argv[1]) : 100000;
+
+  NullBuf null_buf;
+  ostream null_os{&null_buf};
+  cc::Logger logger{null_os, cc::LogSeverity::DEBUG};
+
+  for (size_t size: {64, 1500}) {
+    vector<unsigned char> payload(size);
+    for (size_t i = 0; i < size; ++i) {
+      payload[i] = static_cast<unsigned char>(i * 131);
+    }
+
+    cout << "Payload of " << size << " bytes" << endl;
+    run("  hex, std::hex/std::setw loop", iterations, [&](int) {
+      cc::LoggerDelegate &&line = logger.log(cc::LogSeverity::DEBUG);
+      line << "payload ";
+      for (auto byte: payload) {
+        line << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+      }
+    });
+    run("  hex, cc::hexdump", iterations, [&](int) {
+      logger.log(cc::LogSeverity::DEBUG) << "payload " << cc::hexdump(payload.data(), payload.size());
+    });
+    run("  base64, cc::base64", iterations, [&](int) {
+      logger.log(cc::LogSeverity::DEBUG) << "payload " << cc::base64(payload.data(), payload.size());
+    });
+  }
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "logger.hh"
+
+using namespace std;
+
+namespace {
+
+// std::ostream discarding everything, so only the formatting cost is measured
+class NullBuf final: public streambuf {
+protected:
+  int_type overflow(int_type ch) override { return traits_type::not_eof(ch); }
+  streamsize xsputn(const char *, streamsize count) override { return count; }
+};
+
+// The message assembly used before the fast formatting paths: a std::stringstream per line,
+// copied out with str() when the line is complete
+class StringStreamDelegate final {
+public:
+  StringStreamDelegate(ostream &os, const string &preamble): m_os{os}, m_preamble{preamble} {}
+  ~StringStreamDelegate() {
+    const lock_guard<mutex> lock(m_mut);
+    m_os << m_preamble << m_ss.str() << endl;
+  }
+
+  template<typename T> ostream &operator<<(T&& rhs) {
+    m_ss << std::forward<T>(rhs);
+    return m_ss;
+  }
+
+private:
+  static mutex m_mut;
+  ostream &m_os;
+  string m_preamble;
+  stringstream m_ss;
+};
+
+mutex StringStreamDelegate::m_mut;
+
+template<typename F> void run(const char *name, int iterations, F f)
+{
+  const auto start = chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i) {
+    f(i);
+  }
+  const auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+  cout << left << setw(40) << name << right << setw(10)
+       << static_cast<double>(elapsed.count()) / iterations << " ns/line" << endl;
+}
+
+} //namespace
+
+int main(int argc, char **argv)
+{
+  const int iterations = (argc > 1) ? stoi(argv[1]) : 1000000;
+
+  NullBuf null_buf;
+  ostream null_os{&null_buf};
+  cc::Logger logger{null_os, cc::LogSeverity::DEBUG};
+
+  const double n_double{29287449.197389950734954837};
+
+  run("integers, stringstream", iterations, [&](int i) {
+    StringStreamDelegate{null_os, "[INFO ] "} << "id=" << i << " count=" << i * 7 << " total=" << 1000000LL * i;
+  });
+  run("integers, logger", iterations, [&](int i) {
+    logger.log(cc::LogSeverity::INFO) << "id=" << i << " count=" << i * 7 << " total=" << 1000000LL * i;
+  });
+
+  run("doubles, stringstream", iterations, [&](int i) {
+    StringStreamDelegate{null_os, "[INFO ] "} << "x=" << i * 0.25 << " y=" << n_double / (i + 1);
+  });
+  run("doubles, logger", iterations, [&](int i) {
+    logger.log(cc::LogSeverity::INFO) << "x=" << i * 0.25 << " y=" << n_double / (i + 1);
+  });
+
+  run("fixed/setprecision, stringstream", iterations, [&](int i) {
+    StringStreamDelegate{null_os, "[INFO ] "} << "v=" << fixed << setprecision(8) << n_double + i;
+  });
+  run("fixed/setprecision, logger", iterations, [&](int i) {
+    logger.log(cc::LogSeverity::INFO) << "v=" << fixed << setprecision(8) << n_double + i;
+  });
+
+  run("hex/setw, stringstream", iterations, [&](int i) {
+    StringStreamDelegate{null_os, "[INFO ] "} << "h=" << hex << i << " #" << setw(10) << i << "#";
+  });
+  run("hex/setw, logger", iterations, [&](int i) {
+    logger.log(cc::LogSeverity::INFO) << "h=" << hex << i << " #" << setw(10) << i << "#";
+  });
+
+  run("filtered out, logger", iterations, [&](int i) {
+    logger.log(cc::LogSeverity::TRACE) << "id=" << i << " x=" << i * 0.25;
+  });
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "format.hh"
+#include "log_query.hh"
+
+namespace {
+
+void usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options] PATTERN FILE\n"
+        << "Searches a log file written by cc::IndexedLogFile, using its index to skip blocks.\n"
+        << "An empty PATTERN (\"\") matches every line.\n\n"
+        << "Options:\n"
+        << "  -f, --from TIME       Lines logged at TIME or later (UTC, 2023-05-01T13:45:07[.123456])\n"
+        << "  -t, --to TIME         Lines logged at TIME or earlier (UTC)\n"
+        << "  -s, --severity SEV    Lines of severity SEV or higher (TRACE, DEBUG, INFO, WARN, ERROR, FATAL)\n"
+        << "  -j, --threads N       Number of searching threads (default: one per hardware thread)\n"
+        << "  -c, --count           Print only the number of matching lines\n"
+        << "  -v, --verbose         Print search statistics to stderr\n"
+        << "  -h, --help            Print this help\n";
+}
+
+bool parse_time(const std::string &text, std::int64_t &micros)
+{
+    return cc::parse_utc_timestamp(text.data(), text.size(), micros) == text.size();
+}
+
+bool parse_severity(const std::string &text, cc::LogSeverity &sev)
+{
+    static const struct {
+        const char *name;
+        cc::LogSeverity sev;
+    } names[] = {
+        {"TRACE", cc::LogSeverity::TRACE}, {"DEBUG", cc::LogSeverity::DEBUG},
+        {"INFO", cc::LogSeverity::INFO}, {"WARN", cc::LogSeverity::WARN},
+        {"ERROR", cc::LogSeverity::ERROR}, {"FATAL", cc::LogSeverity::FATAL}
+    };
+
+    for (const auto &name: names) {
+        if (text == name.name) {
+            sev = name.sev;
+            return true;
+        }
+    }
+    return false;
+}
+
+} //namespace
+
+int main(int argc, char **argv)
+{
+    cc::LogQuery query;
+    bool verbose = false;
+    std::string positional[2];
+    int n_positional = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg{argv[i]};
+        const bool has_value = (i + 1 < argc);
+
+        if ((arg == "-h") || (arg == "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if ((arg == "-c") || (arg == "--count")) {
+            query.count_only = true;
+        } else if ((arg == "-v") || (arg == "--verbose")) {
+            verbose = true;
+        } else if (((arg == "-f") || (arg == "--from")) && has_value) {
+            if (!parse_time(argv[++i], query.from_micros)) {
+                std::cerr << "Invalid time: " << argv[i] << "\n";
+                return 2;
+            }
+        } else if (((arg == "-t") || (arg == "--to")) && has_value) {
+            if (!parse_time(argv[++i], query.to_micros)) {
+                std::cerr << "Invalid time: " << argv[i] << "\n";
+                return 2;
+            }
+        } else if (((arg == "-s") || (arg == "--severity")) && has_value) {
+            if (!parse_severity(argv[++i], query.min_severity)) {
+                std::cerr << "Invalid severity: " << argv[i] << "\n";
+                return 2;
+            }
+        } else if (((arg == "-j") || (arg == "--threads")) && has_value) {
+            query.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if ((n_positional < 2) && ((arg.empty()) || (arg[0] != '-') || (arg == "-"))) {
+            positional[n_positional++] = arg;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (n_positional != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+    query.pattern = positional[0];
+
+    std::ios_base::sync_with_stdio(false);
+
+    cc::LogQueryStats stats;
+    if (!cc::query_log(positional[1], query, std::cout, stats)) {
+        std::cerr << "Can't open " << positional[1] << "\n";
+        return 2;
+    }
+
+    if (query.count_only) {
+        std::cout << stats.matches << "\n";
+    }
+    std::cout.flush();
+
+    if (verbose) {
+        std::cerr << "blocks: " << stats.blocks << ", skipped: " << stats.skipped_blocks
+            << ", scanned bytes: " << stats.scanned_bytes << ", matches: " << stats.matches << "\n";
+    }
+
+    // Same convention as grep: 1 when nothing matched
+    return (stats.matches > 0) ? 0 : 1;
+}
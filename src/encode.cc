@@ -0,0 +1,286 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include "encode.hh"
+#include "format.hh"
+
+// The SIMD kernels are compiled for their instruction set with target attributes and selected
+// at run time, so the rest of the code keeps the default compiler flags
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CC_ENCODE_X86
+#include <immintrin.h>
+#endif
+
+namespace cc {
+
+namespace {
+
+const char hex_digits[] = "0123456789abcdef";
+
+const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void hex_encode_scalar(const unsigned char *src, std::size_t len, char *dst)
+{
+    for (std::size_t i = 0; i < len; ++i) {
+        dst[2 * i] = hex_digits[src[i] >> 4];
+        dst[2 * i + 1] = hex_digits[src[i] & 0x0f];
+    }
+}
+
+void base64_encode_scalar(const unsigned char *src, std::size_t len, char *dst)
+{
+    std::size_t i = 0;
+    for (; i + 3 <= len; i += 3) {
+        const unsigned bits = (static_cast<unsigned>(src[i]) << 16) |
+            (static_cast<unsigned>(src[i + 1]) << 8) | src[i + 2];
+        *dst++ = base64_alphabet[bits >> 18];
+        *dst++ = base64_alphabet[(bits >> 12) & 0x3f];
+        *dst++ = base64_alphabet[(bits >> 6) & 0x3f];
+        *dst++ = base64_alphabet[bits & 0x3f];
+    }
+
+    const std::size_t rest = len - i;
+    if (rest == 0) {
+        return;
+    }
+    const unsigned bits = (static_cast<unsigned>(src[i]) << 16) |
+        ((rest == 2) ? (static_cast<unsigned>(src[i + 1]) << 8) : 0);
+    *dst++ = base64_alphabet[bits >> 18];
+    *dst++ = base64_alphabet[(bits >> 12) & 0x3f];
+    *dst++ = (rest == 2) ? base64_alphabet[(bits >> 6) & 0x3f] : '=';
+    *dst = '=';
+}
+
+#ifdef CC_ENCODE_X86
+
+// Nibbles to ASCII without lookup: '0' + n, plus the gap up to 'a' for n > 9
+__attribute__((target("sse2")))
+void hex_encode_sse2(const unsigned char *src, std::size_t len, char *dst)
+{
+    const __m128i low_nibble = _mm_set1_epi8(0x0f);
+    const __m128i ascii_zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i letter_gap = _mm_set1_epi8('a' - '0' - 10);
+
+    std::size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibble);
+        __m128i lo = _mm_and_si128(v, low_nibble);
+        hi = _mm_add_epi8(_mm_add_epi8(hi, ascii_zero),
+            _mm_and_si128(_mm_cmpgt_epi8(hi, nine), letter_gap));
+        lo = _mm_add_epi8(_mm_add_epi8(lo, ascii_zero),
+            _mm_and_si128(_mm_cmpgt_epi8(lo, nine), letter_gap));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    hex_encode_scalar(src + i, len - i, dst + 2 * i);
+}
+
+// Nibbles to ASCII with a vpshufb lookup of the 16 digits
+__attribute__((target("avx2")))
+void hex_encode_avx2(const unsigned char *src, std::size_t len, char *dst)
+{
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+    const __m256i lut = _mm256_setr_epi8(
+        '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+        '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+
+    std::size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        const __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+        const __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low_nibble));
+        // Unpacking works per 128 bits lane, so the lanes are put back in order
+        const __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        const __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    hex_encode_scalar(src + i, len - i, dst + 2 * i);
+}
+
+// Base64 kernels after W. Mula and D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2
+// Instructions". Each 3 bytes are spread to 4 bytes holding 6 bits each, which are translated
+// to ASCII adding an offset looked up by range
+__attribute__((target("ssse3")))
+void base64_encode_ssse3(const unsigned char *src, std::size_t len, char *dst)
+{
+    const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m128i shift_lut = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    std::size_t i = 0;
+    char *out = dst;
+    // 16 bytes are loaded but only 12 are encoded
+    for (; i + 16 <= len; i += 12, out += 16) {
+        const __m128i in = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)), spread);
+        const __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)),
+            _mm_set1_epi32(0x04000040));
+        const __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)),
+            _mm_set1_epi32(0x01000010));
+        const __m128i indices = _mm_or_si128(t0, t1);
+
+        __m128i shift = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+        const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+        shift = _mm_or_si128(shift, _mm_and_si128(upper, _mm_set1_epi8(13)));
+        shift = _mm_shuffle_epi8(shift_lut, shift);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_add_epi8(indices, shift));
+    }
+    base64_encode_scalar(src + i, len - i, out);
+}
+
+__attribute__((target("avx2")))
+void base64_encode_avx2(const unsigned char *src, std::size_t len, char *dst)
+{
+    const __m256i spread = _mm256_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+    const __m256i shift_lut = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+    std::size_t i = 0;
+    char *out = dst;
+    // Each lane gets 12 bytes from its own 16 bytes load, so 28 bytes must be readable
+    for (; i + 28 <= len; i += 24, out += 32) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 12));
+        const __m256i in = _mm256_shuffle_epi8(
+            _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), spread);
+        const __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+            _mm256_set1_epi32(0x04000040));
+        const __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+            _mm256_set1_epi32(0x01000010));
+        const __m256i indices = _mm256_or_si256(t0, t1);
+
+        __m256i shift = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        shift = _mm256_or_si256(shift, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+        shift = _mm256_shuffle_epi8(shift_lut, shift);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_add_epi8(indices, shift));
+    }
+    base64_encode_scalar(src + i, len - i, out);
+}
+
+#endif //CC_ENCODE_X86
+
+void append_truncation(std::string &out, std::size_t len)
+{
+    out.append("... (");
+    append_integer(out, len);
+    out.append(" bytes)");
+}
+
+// The best kernel among levels, tried from the most capable one
+EncodeFunction select_encoder(EncodeFunction (*encoder)(EncodeLevel))
+{
+    const EncodeLevel levels[] = {EncodeLevel::AVX2, EncodeLevel::SSE, EncodeLevel::SCALAR};
+    for (EncodeLevel level: levels) {
+        if (const EncodeFunction function = encoder(level)) {
+            return function;
+        }
+    }
+    return nullptr;
+}
+
+} //namespace
+
+EncodeFunction hex_encoder(EncodeLevel level)
+{
+    switch (level) {
+        case EncodeLevel::SCALAR: return hex_encode_scalar;
+#ifdef CC_ENCODE_X86
+        case EncodeLevel::SSE:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2") ? hex_encode_sse2 : nullptr;
+        case EncodeLevel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? hex_encode_avx2 : nullptr;
+#endif //CC_ENCODE_X86
+    default:
+        return nullptr;
+    }
+}
+
+EncodeFunction base64_encoder(EncodeLevel level)
+{
+    switch (level) {
+        case EncodeLevel::SCALAR: return base64_encode_scalar;
+#ifdef CC_ENCODE_X86
+        case EncodeLevel::SSE:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("ssse3") ? base64_encode_ssse3 : nullptr;
+        case EncodeLevel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2") ? base64_encode_avx2 : nullptr;
+#endif //CC_ENCODE_X86
+    default:
+        return nullptr;
+    }
+}
+
+void hex_encode(const unsigned char *src, std::size_t len, char *dst)
+{
+    static const EncodeFunction encoder = select_encoder(hex_encoder);
+    encoder(src, len, dst);
+}
+
+void base64_encode(const unsigned char *src, std::size_t len, char *dst)
+{
+    static const EncodeFunction encoder = select_encoder(base64_encoder);
+    encoder(src, len, dst);
+}
+
+void append_encoded(std::string &out, const HexDump &dump)
+{
+    const bool truncated = (dump.max_len > 0) && (dump.len > dump.max_len);
+    const std::size_t len = truncated ? dump.max_len : dump.len;
+
+    const std::string::size_type start = out.size();
+    out.resize(start + 2 * len);
+    hex_encode(dump.data, len, &out[start]);
+
+    if (truncated) {
+        append_truncation(out, dump.len);
+    }
+}
+
+void append_encoded(std::string &out, const Base64 &dump)
+{
+    const bool truncated = (dump.max_len > 0) && (dump.len > dump.max_len);
+    const std::size_t len = truncated ? dump.max_len : dump.len;
+
+    const std::string::size_type start = out.size();
+    out.resize(start + base64_encoded_length(len));
+    base64_encode(dump.data, len, &out[start]);
+
+    if (truncated) {
+        append_truncation(out, dump.len);
+    }
+}
+
+std::ostream &operator<<(std::ostream &os, const HexDump &dump)
+{
+    std::string encoded;
+    append_encoded(encoded, dump);
+    return os << encoded;
+}
+
+std::ostream &operator<<(std::ostream &os, const Base64 &dump)
+{
+    std::string encoded;
+    append_encoded(encoded, dump);
+    return os << encoded;
+}
+
+} //namespace cc
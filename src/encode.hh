@@ -0,0 +1,145 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#ifndef __CC_ENCODE_H__
+#define __CC_ENCODE_H__
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace cc {
+
+/**
+ * @brief Binary buffer to be logged in hexadecimal. Created by \ref hexdump.
+ */
+struct HexDump {
+  /** The bytes to encode */
+  const unsigned char *data;
+  /** The number of bytes of the buffer */
+  std::size_t len;
+  /** Maximum number of bytes encoded. 0 means no limit */
+  std::size_t max_len;
+};
+
+/**
+ * @brief Binary buffer to be logged in base64. Created by \ref base64.
+ */
+struct Base64 {
+  /** The bytes to encode */
+  const unsigned char *data;
+  /** The number of bytes of the buffer */
+  std::size_t len;
+  /** Maximum number of bytes encoded. 0 means no limit */
+  std::size_t max_len;
+};
+
+/**
+ * @brief Logs a binary buffer as lowercase hexadecimal digits, two per byte:
+ *
+ * `cc::debug_log() << "Packet: " << cc::hexdump(packet, packet_len, 64);`
+ *
+ * The buffer is encoded straight into the message buffer, using SSE2 or AVX2 when available.
+ * When the buffer is longer than max_len, only its first max_len bytes are encoded, followed by
+ * `...` and the total length, like `0a1b2c... (1500 bytes)`.
+ * @param data The buffer. It must be valid until the log line is complete
+ * @param len The length of the buffer in bytes
+ * @param max_len Maximum number of bytes encoded. 0 means no limit
+ */
+inline HexDump hexdump(const void *data, std::size_t len, std::size_t max_len = 0)
+{
+  return HexDump{static_cast<const unsigned char *>(data), len, max_len};
+}
+
+/**
+ * @brief Logs a binary buffer in base64 (RFC 4648, with padding):
+ *
+ * `cc::debug_log() << "Record: " << cc::base64(record, record_len);`
+ *
+ * The buffer is encoded straight into the message buffer, using SSSE3 or AVX2 when available.
+ * Truncation works like in \ref hexdump.
+ * @param data The buffer. It must be valid until the log line is complete
+ * @param len The length of the buffer in bytes
+ * @param max_len Maximum number of bytes encoded. 0 means no limit
+ */
+inline Base64 base64(const void *data, std::size_t len, std::size_t max_len = 0)
+{
+  return Base64{static_cast<const unsigned char *>(data), len, max_len};
+}
+
+/**
+ * @brief Encodes bytes as lowercase hexadecimal digits.
+ * @param src The bytes to encode
+ * @param len The number of bytes
+ * @param dst Where the 2 * len digits are written
+ */
+void hex_encode(const unsigned char *src, std::size_t len, char *dst);
+
+/**
+ * @brief Length of the base64 encoding of a number of bytes, padding included.
+ */
+inline std::size_t base64_encoded_length(std::size_t len) { return (len + 2) / 3 * 4; }
+
+/**
+ * @brief Encodes bytes in base64, with padding.
+ * @param src The bytes to encode
+ * @param len The number of bytes
+ * @param dst Where the base64_encoded_length(len) characters are written
+ */
+void base64_encode(const unsigned char *src, std::size_t len, char *dst);
+
+/**
+ * @brief Enum class representing the instruction sets the encoding kernels are written for.
+ */
+enum class EncodeLevel {
+  SCALAR, /**< Plain C++, available everywhere */
+  SSE, /**< SSE2 for hexadecimal, SSSE3 for base64 */
+  AVX2 /**< AVX2 */
+};
+
+/**
+ * @brief Signature of the encoding kernels, like \ref hex_encode and \ref base64_encode.
+ */
+typedef void (*EncodeFunction)(const unsigned char *src, std::size_t len, char *dst);
+
+/**
+ * @brief The hexadecimal kernel of an instruction set level, to test or benchmark it.
+ * \ref hex_encode uses the most capable one the CPU supports.
+ * @return nullptr if the CPU or the build doesn't support the level
+ */
+EncodeFunction hex_encoder(EncodeLevel level);
+
+/**
+ * @brief The base64 kernel of an instruction set level, to test or benchmark it.
+ * \ref base64_encode uses the most capable one the CPU supports.
+ * @return nullptr if the CPU or the build doesn't support the level
+ */
+EncodeFunction base64_encoder(EncodeLevel level);
+
+/**
+ * @brief Appends a \ref HexDump to a string, applying its truncation limit.
+ */
+void append_encoded(std::string &out, const HexDump &dump);
+
+/**
+ * @brief Appends a \ref Base64 to a string, applying its truncation limit.
+ */
+void append_encoded(std::string &out, const Base64 &dump);
+
+/**
+ * @brief Stream insertion operator overloading for \ref HexDump, for any std::ostream.
+ */
+std::ostream &operator<<(std::ostream &os, const HexDump &dump);
+
+/**
+ * @brief Stream insertion operator overloading for \ref Base64, for any std::ostream.
+ */
+std::ostream &operator<<(std::ostream &os, const Base64 &dump);
+
+} //namespace cc
+
+#endif //__CC_ENCODE_H__
@@ -0,0 +1,627 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+
+#include "format.hh"
+
+namespace cc {
+
+namespace {
+
+const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Words of the big integers used to expand long doubles, whose integer part can take 16384 bits
+// and whose fraction can take 16445 + 64 bits
+const std::size_t max_words = 520;
+
+// Exact decimal expansion of mantissa * 2^exponent: the digits of the integer part, then the
+// digits of the fraction generated one at a time. The fraction is kept aligned to the top of its
+// 32 bit words, so multiplying it by 10 carries the next digit out of the top word
+class DecimalExpansion {
+public:
+    DecimalExpansion(std::uint64_t mantissa, int exponent);
+
+    const std::string &integer_digits() const { return m_integer; }
+    bool fraction_is_zero() const;
+    int next_fraction_digit();
+
+private:
+    void expand_big_integer(std::uint64_t mantissa, int exponent);
+
+    std::string m_integer;
+    std::uint32_t m_fraction[max_words];
+    std::size_t m_fraction_words;
+};
+
+DecimalExpansion::DecimalExpansion(std::uint64_t mantissa, int exponent):
+    m_integer{},
+    m_fraction_words{0}
+{
+    if (exponent >= 0) {
+        if ((exponent < 64) && (((mantissa >> (63 - exponent)) >> 1) == 0)) {
+            if (mantissa != 0) {
+                append_decimal(m_integer, mantissa << exponent, false);
+            }
+        } else {
+            expand_big_integer(mantissa, exponent);
+        }
+        return;
+    }
+
+    const unsigned shift = static_cast<unsigned>(-exponent);
+    const std::uint64_t integer = (shift < 64) ? (mantissa >> shift) : 0;
+    if (integer != 0) {
+        append_decimal(m_integer, integer, false);
+    }
+
+    // The fraction has shift bits. Aligned to the top of its words it becomes
+    // fraction << (32 * words - shift), which spans at most 3 words
+    const std::uint64_t fraction = (shift < 64) ? (mantissa & ((1ULL << shift) - 1)) : mantissa;
+    m_fraction_words = (shift + 31) / 32;
+    const unsigned align = static_cast<unsigned>(32 * m_fraction_words - shift);
+    for (std::size_t i = 0; i < m_fraction_words; ++i) {
+        m_fraction[i] = 0;
+    }
+    const std::uint64_t low = fraction << align;
+    m_fraction[0] = static_cast<std::uint32_t>(low);
+    if (m_fraction_words > 1) {
+        m_fraction[1] = static_cast<std::uint32_t>(low >> 32);
+    }
+    if ((m_fraction_words > 2) && (align != 0)) {
+        m_fraction[2] = static_cast<std::uint32_t>(fraction >> (64 - align));
+    }
+}
+
+void DecimalExpansion::expand_big_integer(std::uint64_t mantissa, int exponent)
+{
+    std::uint32_t words[max_words];
+    const std::size_t word_shift = static_cast<std::size_t>(exponent) / 32;
+    const unsigned bit_shift = static_cast<unsigned>(exponent) % 32;
+    std::size_t n = word_shift + 3;
+    for (std::size_t i = 0; i < n; ++i) {
+        words[i] = 0;
+    }
+    const std::uint64_t low = mantissa << bit_shift;
+    words[word_shift] = static_cast<std::uint32_t>(low);
+    words[word_shift + 1] = static_cast<std::uint32_t>(low >> 32);
+    if (bit_shift != 0) {
+        words[word_shift + 2] = static_cast<std::uint32_t>(mantissa >> (64 - bit_shift));
+    }
+    while ((n > 0) && (words[n - 1] == 0)) {
+        --n;
+    }
+
+    // Chunks of 9 digits, least significant first
+    std::string reversed;
+    while (n > 0) {
+        std::uint64_t rem = 0;
+        for (std::size_t i = n; i-- > 0;) {
+            const std::uint64_t cur = (rem << 32) | words[i];
+            words[i] = static_cast<std::uint32_t>(cur / 1000000000);
+            rem = cur % 1000000000;
+        }
+        while ((n > 0) && (words[n - 1] == 0)) {
+            --n;
+        }
+        for (int i = 0; i < 9; ++i) {
+            reversed.push_back(static_cast<char>('0' + rem % 10));
+            rem /= 10;
+        }
+    }
+    while (!reversed.empty() && (reversed.back() == '0')) {
+        reversed.pop_back();
+    }
+    m_integer.assign(reversed.rbegin(), reversed.rend());
+}
+
+bool DecimalExpansion::fraction_is_zero() const
+{
+    for (std::size_t i = 0; i < m_fraction_words; ++i) {
+        if (m_fraction[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int DecimalExpansion::next_fraction_digit()
+{
+    std::uint32_t carry = 0;
+    for (std::size_t i = 0; i < m_fraction_words; ++i) {
+        const std::uint64_t cur = static_cast<std::uint64_t>(m_fraction[i]) * 10 + carry;
+        m_fraction[i] = static_cast<std::uint32_t>(cur);
+        carry = static_cast<std::uint32_t>(cur >> 32);
+    }
+    return static_cast<int>(carry);
+}
+
+// Rounds the digits half to even, like glibc's printf. round_digit is the first digit dropped,
+// and sticky tells whether any digit after it is not zero. Returns true if a carry came out of
+// the first digit, in which case the digits became 1000...
+bool round_digits(std::string &digits, int round_digit, bool sticky)
+{
+    const bool odd = !digits.empty() && ((digits.back() - '0') % 2 == 1);
+    if ((round_digit < 5) || ((round_digit == 5) && !sticky && !odd)) {
+        return false;
+    }
+    for (std::size_t i = digits.size(); i-- > 0;) {
+        if (digits[i] != '9') {
+            ++digits[i];
+            return false;
+        }
+        digits[i] = '0';
+    }
+    digits.insert(digits.begin(), '1');
+    return true;
+}
+
+// Digits of the value rounded to a number of digits after the point. point is the number of
+// digits of the integer part, 0 when it's zero
+void fixed_digits(DecimalExpansion &expansion, int precision, std::string &digits, int &point)
+{
+    digits = expansion.integer_digits();
+    point = static_cast<int>(digits.size());
+    for (int i = 0; i < precision; ++i) {
+        digits.push_back(static_cast<char>('0' + expansion.next_fraction_digit()));
+    }
+    const int round_digit = expansion.next_fraction_digit();
+    if (round_digits(digits, round_digit, !expansion.fraction_is_zero())) {
+        ++point;
+    }
+}
+
+// Digits of the value rounded to a number of significant digits, the value being
+// 0.digits * 10^point. A zero value gives zero digits and point 1. Returns true if the rounding
+// carried into a new digit
+bool significant_digits(DecimalExpansion &expansion, int count, std::string &digits, int &point)
+{
+    const std::string &integer = expansion.integer_digits();
+    const std::size_t wanted = static_cast<std::size_t>(count);
+    int round_digit = 0;
+    bool sticky = false;
+
+    point = static_cast<int>(integer.size());
+    if (integer.size() >= wanted) {
+        digits.assign(integer, 0, wanted);
+        if (integer.size() > wanted) {
+            round_digit = integer[wanted] - '0';
+            sticky = (integer.find_first_not_of('0', wanted + 1) != std::string::npos) ||
+                !expansion.fraction_is_zero();
+        } else {
+            round_digit = expansion.next_fraction_digit();
+            sticky = !expansion.fraction_is_zero();
+        }
+    } else {
+        digits = integer;
+        if (integer.empty()) {
+            if (expansion.fraction_is_zero()) {
+                digits.assign(wanted, '0');
+                point = 1;
+                return false;
+            }
+            int digit = expansion.next_fraction_digit();
+            while (digit == 0) {
+                --point;
+                digit = expansion.next_fraction_digit();
+            }
+            digits.push_back(static_cast<char>('0' + digit));
+        }
+        while (digits.size() < wanted) {
+            digits.push_back(static_cast<char>('0' + expansion.next_fraction_digit()));
+        }
+        round_digit = expansion.next_fraction_digit();
+        sticky = !expansion.fraction_is_zero();
+    }
+
+    if (round_digits(digits, round_digit, sticky)) {
+        digits.pop_back();
+        ++point;
+        return true;
+    }
+    return false;
+}
+
+void append_exponent(std::string &out, int exponent, bool uppercase)
+{
+    out.push_back(uppercase ? 'E' : 'e');
+    out.push_back(exponent < 0 ? '-' : '+');
+    const unsigned magnitude = static_cast<unsigned>(exponent < 0 ? -exponent : exponent);
+    if (magnitude < 10) {
+        out.push_back('0');
+    }
+    append_decimal(out, magnitude, false);
+}
+
+// %e with the digits of significant_digits
+void append_scientific(std::string &out, const std::string &digits, int point, bool showpoint,
+    bool uppercase)
+{
+    out.push_back(digits[0]);
+    if ((digits.size() > 1) || showpoint) {
+        out.push_back('.');
+    }
+    out.append(digits, 1, std::string::npos);
+    append_exponent(out, (digits[0] == '0') ? 0 : point - 1, uppercase);
+}
+
+// %f with the digits of fixed_digits
+void append_fixed(std::string &out, const std::string &digits, int point, bool showpoint)
+{
+    const std::size_t integer_len = static_cast<std::size_t>(point);
+    if (integer_len == 0) {
+        out.push_back('0');
+    } else {
+        out.append(digits, 0, integer_len);
+    }
+    if ((digits.size() > integer_len) || showpoint) {
+        out.push_back('.');
+    }
+    out.append(digits, integer_len, std::string::npos);
+}
+
+// %g: %e or %f depending on the exponent, without trailing zeros unless showpoint is set
+void append_general(std::string &out, DecimalExpansion &expansion, int precision, bool showpoint,
+    bool uppercase)
+{
+    const int count = (precision == 0) ? 1 : precision;
+    std::string digits;
+    int point = 0;
+    const bool carried = significant_digits(expansion, count, digits, point);
+    const int exponent = (digits[0] == '0') ? 0 : point - 1;
+
+    if (!showpoint) {
+        const std::string::size_type last = digits.find_last_not_of('0');
+        digits.resize(last == std::string::npos ? 1 : last + 1);
+    } else if (carried && (exponent == count)) {
+        // glibc keeps the fraction digits of the fixed notation chosen before rounding, which
+        // are none: 99.96 with %#.2g is 1.e+02
+        digits.resize(1);
+    }
+
+    if ((exponent < -4) || (exponent >= count)) {
+        append_scientific(out, digits, point, showpoint, uppercase);
+        return;
+    }
+
+    // The same digits in fixed notation, with the zeros needed around the point
+    if (exponent < 0) {
+        out.append("0.");
+        out.append(static_cast<std::size_t>(-exponent - 1), '0');
+        out.append(digits);
+        return;
+    }
+    const std::size_t integer_len = static_cast<std::size_t>(exponent) + 1;
+    if (digits.size() <= integer_len) {
+        out.append(digits);
+        out.append(integer_len - digits.size(), '0');
+        if (showpoint) {
+            out.push_back('.');
+        }
+        return;
+    }
+    out.append(digits, 0, integer_len);
+    out.push_back('.');
+    out.append(digits, integer_len, std::string::npos);
+}
+
+// Formats mantissa * 2^exponent like printf does with the conversion chosen by the stream flags,
+// without depending on the C locale
+void append_binary_floating(std::string &out, bool negative, bool finite, bool nan,
+    std::uint64_t mantissa, int exponent, std::ios_base::fmtflags flags, std::streamsize precision)
+{
+    const std::ios_base::fmtflags floatfield = flags & std::ios_base::floatfield;
+    // Like std::num_put, fixed notation uses %f even with uppercase, so inf and nan stay lowercase
+    const bool uppercase = ((flags & std::ios_base::uppercase) != 0) &&
+        (floatfield != std::ios_base::fixed);
+    const bool showpoint = (flags & std::ios_base::showpoint) != 0;
+    if (negative) {
+        out.push_back('-');
+    } else if (flags & std::ios_base::showpos) {
+        out.push_back('+');
+    }
+    if (!finite) {
+        out.append(nan ? (uppercase ? "NAN" : "nan") : (uppercase ? "INF" : "inf"));
+        return;
+    }
+
+    // Same default std::num_put uses for out of range precisions
+    const int digits_precision = (precision < 0) ? 6 :
+        static_cast<int>(precision < 100000 ? precision : 100000);
+    DecimalExpansion expansion{mantissa, exponent};
+    std::string digits;
+    int point = 0;
+    if (floatfield == std::ios_base::fixed) {
+        fixed_digits(expansion, digits_precision, digits, point);
+        append_fixed(out, digits, point, showpoint);
+    } else if (floatfield == std::ios_base::scientific) {
+        significant_digits(expansion, digits_precision + 1, digits, point);
+        append_scientific(out, digits, point, showpoint, uppercase);
+    } else {
+        append_general(out, expansion, digits_precision, showpoint, uppercase);
+    }
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date, and its inverse.
+// Algorithms from http://howardhinnant.github.io/date_algorithms.html
+std::int64_t days_from_civil(std::int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+void civil_from_days(std::int64_t z, std::int64_t &y, unsigned &m, unsigned &d)
+{
+    z += 719468;
+    const std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(z - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = static_cast<std::int64_t>(yoe) + era * 400 + (m <= 2);
+}
+
+void put_two_digits(char *p, unsigned value)
+{
+    p[0] = digit_pairs[value * 2];
+    p[1] = digit_pairs[value * 2 + 1];
+}
+
+bool get_digits(const char *s, std::size_t count, unsigned &value)
+{
+    value = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        if ((s[i] < '0') || (s[i] > '9')) {
+            return false;
+        }
+        value = value * 10 + static_cast<unsigned>(s[i] - '0');
+    }
+    return true;
+}
+
+} //namespace
+
+void append_decimal(std::string &out, unsigned long long magnitude, bool negative)
+{
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *p = end;
+
+    while (magnitude >= 100) {
+        const unsigned idx = static_cast<unsigned>(magnitude % 100) * 2;
+        magnitude /= 100;
+        *--p = digit_pairs[idx + 1];
+        *--p = digit_pairs[idx];
+    }
+    if (magnitude >= 10) {
+        const unsigned idx = static_cast<unsigned>(magnitude) * 2;
+        *--p = digit_pairs[idx + 1];
+        *--p = digit_pairs[idx];
+    } else {
+        *--p = static_cast<char>('0' + magnitude);
+    }
+    if (negative) {
+        *--p = '-';
+    }
+
+    out.append(p, end - p);
+}
+
+void append_floating(std::string &out, double value, std::ios_base::fmtflags flags,
+    std::streamsize precision)
+{
+    int exponent = 0;
+    const double fraction = std::frexp(value, &exponent);
+    const bool finite = std::isfinite(value);
+    const std::uint64_t mantissa = finite ?
+        static_cast<std::uint64_t>(std::ldexp(std::fabs(fraction), 53)) : 0;
+    append_binary_floating(out, std::signbit(value), finite, std::isnan(value), mantissa,
+        exponent - 53, flags, precision);
+}
+
+void append_floating(std::string &out, long double value, std::ios_base::fmtflags flags,
+    std::streamsize precision)
+{
+    if (std::numeric_limits<long double>::digits > 64) {
+        // The mantissa doesn't fit the expansion. std::num_put of the classic locale is exact
+        std::ostringstream oss;
+        oss.imbue(std::locale::classic());
+        oss.flags(flags);
+        oss.precision(precision);
+        oss << value;
+        out.append(oss.str());
+        return;
+    }
+
+    int exponent = 0;
+    const long double fraction = std::frexp(value, &exponent);
+    const bool finite = std::isfinite(value);
+    const std::uint64_t mantissa = finite ?
+        static_cast<std::uint64_t>(std::ldexp(std::fabs(fraction), 64)) : 0;
+    append_binary_floating(out, std::signbit(value), finite, std::isnan(value), mantissa,
+        exponent - 64, flags, precision);
+}
+
+void append_utc_timestamp(std::string &out, std::int64_t micros)
+{
+    const std::int64_t micros_per_day = 86400LL * 1000000LL;
+    std::int64_t days = micros / micros_per_day;
+    std::int64_t rest = micros % micros_per_day;
+    if (rest < 0) {
+        rest += micros_per_day;
+        --days;
+    }
+
+    std::int64_t year;
+    unsigned month;
+    unsigned day;
+    civil_from_days(days, year, month, day);
+
+    const unsigned secs = static_cast<unsigned>(rest / 1000000);
+    const unsigned usecs = static_cast<unsigned>(rest % 1000000);
+
+    // YYYY-MM-DDTHH:MM:SS.uuuuuuZ
+    char buf[utc_timestamp_length];
+    const unsigned y = static_cast<unsigned>(year % 10000);
+    put_two_digits(buf, y / 100);
+    put_two_digits(buf + 2, y % 100);
+    buf[4] = '-';
+    put_two_digits(buf + 5, month);
+    buf[7] = '-';
+    put_two_digits(buf + 8, day);
+    buf[10] = 'T';
+    put_two_digits(buf + 11, secs / 3600);
+    buf[13] = ':';
+    put_two_digits(buf + 14, secs / 60 % 60);
+    buf[16] = ':';
+    put_two_digits(buf + 17, secs % 60);
+    buf[19] = '.';
+    put_two_digits(buf + 20, usecs / 10000);
+    put_two_digits(buf + 22, usecs / 100 % 100);
+    put_two_digits(buf + 24, usecs % 100);
+    buf[26] = 'Z';
+
+    out.append(buf, sizeof(buf));
+}
+
+std::size_t parse_utc_timestamp(const char *s, std::size_t len, std::int64_t &micros)
+{
+    unsigned year, month, day, hour, minute, second;
+    if ((len < 19) ||
+        !get_digits(s, 4, year) || (s[4] != '-') ||
+        !get_digits(s + 5, 2, month) || (s[7] != '-') ||
+        !get_digits(s + 8, 2, day) || ((s[10] != 'T') && (s[10] != ' ')) ||
+        !get_digits(s + 11, 2, hour) || (s[13] != ':') ||
+        !get_digits(s + 14, 2, minute) || (s[16] != ':') ||
+        !get_digits(s + 17, 2, second)) {
+        return 0;
+    }
+    if ((month < 1) || (month > 12) || (day < 1) || (day > 31) || (hour > 23) ||
+        (minute > 59) || (second > 60)) {
+        return 0;
+    }
+
+    std::size_t pos = 19;
+    std::int64_t fraction = 0;
+    if ((pos < len) && (s[pos] == '.')) {
+        ++pos;
+        std::int64_t scale = 100000;
+        while ((pos < len) && (s[pos] >= '0') && (s[pos] <= '9')) {
+            fraction += (s[pos] - '0') * scale;
+            scale /= 10;
+            ++pos;
+        }
+    }
+    if ((pos < len) && (s[pos] == 'Z')) {
+        ++pos;
+    }
+
+    const std::int64_t days = days_from_civil(year, month, day);
+    micros = ((days * 24 + hour) * 60 + minute) * 60 + second;
+    micros = micros * 1000000 + fraction;
+    return pos;
+}
+
+std::int64_t utc_now_micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//MessageStreamBuf
+MessageStreamBuf::MessageStreamBuf(std::string &buffer):
+    std::streambuf{},
+    m_buffer{buffer}
+{}
+
+MessageStreamBuf::int_type MessageStreamBuf::overflow(int_type ch)
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof())) {
+        return traits_type::not_eof(ch);
+    }
+    m_buffer.push_back(traits_type::to_char_type(ch));
+    return ch;
+}
+
+std::streamsize MessageStreamBuf::xsputn(const char *s, std::streamsize count)
+{
+    m_buffer.append(s, static_cast<std::string::size_type>(count));
+    return count;
+}
+
+//LineStreamBuf
+LineStreamBuf::LineStreamBuf():
+    std::streambuf{},
+    m_line{}
+{}
+
+LineStreamBuf::int_type LineStreamBuf::overflow(int_type ch)
+{
+    if (traits_type::eq_int_type(ch, traits_type::eof())) {
+        return traits_type::not_eof(ch);
+    }
+
+    if (traits_type::to_char_type(ch) == '\n') {
+        end_line();
+    } else {
+        m_line.push_back(traits_type::to_char_type(ch));
+    }
+    return ch;
+}
+
+std::streamsize LineStreamBuf::xsputn(const char *s, std::streamsize count)
+{
+    const char *end = s + count;
+    while (s < end) {
+        const char *nl = static_cast<const char *>(std::memchr(s, '\n', end - s));
+        if (nl == nullptr) {
+            m_line.append(s, end);
+            break;
+        }
+        m_line.append(s, nl);
+        end_line();
+        s = nl + 1;
+    }
+    return count;
+}
+
+void LineStreamBuf::complete_last_line()
+{
+    if (!m_line.empty()) {
+        end_line();
+    }
+}
+
+void LineStreamBuf::end_line()
+{
+    complete_line(m_line);
+    m_line.clear();
+}
+
+} //namespace cc
@@ -0,0 +1,250 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#ifndef __CC_FORMAT_H__
+#define __CC_FORMAT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace cc {
+
+/**
+ * @brief Trait telling whether an integral type is formatted as a number by std::ostream.
+ *
+ * bool and the character types are integral, but std::ostream prints them as text, so they are
+ * excluded from the fast integer formatting.
+ * @tparam T The type to check. It must already be decayed.
+ */
+template<typename T> struct is_formattable_integer: std::integral_constant<bool,
+  std::is_integral<T>::value &&
+  !std::is_same<T, bool>::value &&
+  !std::is_same<T, char>::value &&
+  !std::is_same<T, signed char>::value &&
+  !std::is_same<T, unsigned char>::value &&
+  !std::is_same<T, wchar_t>::value &&
+  !std::is_same<T, char16_t>::value &&
+  !std::is_same<T, char32_t>::value> {};
+
+/**
+ * @brief Appends the decimal representation of an integer to a string.
+ *
+ * Digits are generated two at a time from a lookup table, without going through the
+ * std::num_put facet of any locale.
+ * @param out The string where the digits are appended
+ * @param magnitude The absolute value of the number
+ * @param negative Whether a minus sign must be written before the digits
+ */
+void append_decimal(std::string &out, unsigned long long magnitude, bool negative);
+
+/**
+ * @brief Sign check for signed integers.
+ */
+template<typename T> bool is_negative(T value, std::true_type) { return value < 0; }
+/**
+ * @brief Sign check for unsigned integers. Avoids the always false comparison warning.
+ */
+template<typename T> bool is_negative(T, std::false_type) { return false; }
+
+/**
+ * @brief Appends an integer of any type to a string, in decimal.
+ * @tparam T An integral type accepted by \ref is_formattable_integer
+ * @param out The string where the digits are appended
+ * @param value The value to be formatted
+ */
+template<typename T> void append_integer(std::string &out, T value)
+{
+  // The negation is done in unsigned arithmetic so the minimum value of signed types is safe
+  const bool negative = is_negative(value, std::is_signed<T>());
+  unsigned long long magnitude = static_cast<unsigned long long>(value);
+  if (negative) {
+    magnitude = 0ULL - magnitude;
+  }
+  append_decimal(out, magnitude, negative);
+}
+
+/**
+ * @brief Appends a floating point number to a string, with the same result std::num_put gives
+ * for the classic locale.
+ *
+ * The printf conversion (%g, %f, %e and their uppercase versions), the precision, and the
+ * showpos and showpoint flags are taken from the stream state, so the result is the same as
+ * inserting the value in a std::ostream with those flags. Hexfloat is not supported.
+ *
+ * The digits are generated from the exact binary value and rounded half to even, like glibc's
+ * printf does, without printf and without depending on the C locale.
+ * @param out The string where the number is appended
+ * @param value The value to be formatted
+ * @param flags The format flags of the stream the value would have been inserted into
+ * @param precision The precision of the stream the value would have been inserted into
+ */
+void append_floating(std::string &out, double value, std::ios_base::fmtflags flags,
+  std::streamsize precision);
+
+/**
+ * @brief Overload of append_floating(std::string &, double, std::ios_base::fmtflags, std::streamsize)
+ * for long double.
+ */
+void append_floating(std::string &out, long double value, std::ios_base::fmtflags flags,
+  std::streamsize precision);
+
+/**
+ * @brief Length of the timestamps written by \ref append_utc_timestamp
+ */
+const std::size_t utc_timestamp_length = 27;
+
+/**
+ * @brief Appends a UTC timestamp in RFC 3339 format with microseconds, like
+ * `2023-05-01T13:45:07.123456Z`.
+ * @param out The string where the timestamp is appended
+ * @param micros Microseconds since the Unix epoch
+ */
+void append_utc_timestamp(std::string &out, std::int64_t micros);
+
+/**
+ * @brief Parses a UTC timestamp written by \ref append_utc_timestamp.
+ *
+ * The fraction of second and the final `Z` are optional, and a space is accepted instead of the
+ * `T` separator, so dates typed by hand like `2023-05-01 13:45:07` can be parsed too.
+ * @param s The text to parse
+ * @param len The length of the text
+ * @param micros Where the parsed microseconds since the Unix epoch are stored
+ * @return The number of characters parsed, or 0 if the text is not a timestamp
+ */
+std::size_t parse_utc_timestamp(const char *s, std::size_t len, std::int64_t &micros);
+
+/**
+ * @brief Microseconds since the Unix epoch for the current time of std::chrono::system_clock.
+ */
+std::int64_t utc_now_micros();
+
+/**
+ * @brief std::streambuf appending everything written to it to an external std::string.
+ *
+ * It allows a std::ostream and the fast formatting functions to share the same message buffer,
+ * without the copy std::stringstream::str() requires.
+ */
+class MessageStreamBuf final: public std::streambuf {
+public:
+  /**
+   * @brief Constructor of the class.
+   * @param buffer The string where the characters are appended. It must outlive this object.
+   */
+  explicit MessageStreamBuf(std::string &buffer);
+
+protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char *s, std::streamsize count) override;
+
+private:
+  std::string &m_buffer;
+};
+
+/**
+ * @brief std::streambuf splitting the characters written to it into lines, base of the sinks
+ * which handle each log line as a record.
+ *
+ * Like any std::streambuf it is not thread-safe by itself. The \ref Logger class serializes the
+ * writing of the log lines.
+ */
+class LineStreamBuf: public std::streambuf {
+public:
+  /**
+   * @brief Defaulted virtual destructor. Derived classes call \ref complete_last_line() in theirs
+   * if the last line must not be lost.
+   */
+  virtual ~LineStreamBuf() = default;
+
+  /**
+   * @brief Deleted copy constructor
+   */
+  LineStreamBuf(const LineStreamBuf&) = delete;
+  /**
+   * @brief Deleted assignment operator
+   */
+  LineStreamBuf& operator=(const LineStreamBuf&) = delete;
+
+protected:
+  /**
+   * @brief Constructor of the class.
+   */
+  LineStreamBuf();
+
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char *s, std::streamsize count) override;
+
+  /**
+   * @brief Handles a complete line.
+   * @param line The line, without its new line character. It can be modified, or swapped
+   * with another string, since it's cleared afterwards
+   */
+  virtual void complete_line(std::string &line) = 0;
+  /**
+   * @brief Handles the last line if it wasn't ended by a new line character.
+   */
+  void complete_last_line();
+
+private:
+  void end_line();
+
+  std::string m_line;
+};
+
+/**
+ * @brief std::ostream writing to a \ref LineStreamBuf it owns, base of the log sinks.
+ *
+ * Sinks can be used as the output of the logger like any other std::ostream, for example:
+ *
+ * `cc::configure_logger(sink, cc::LogSeverity::INFO);`
+ */
+template<typename StreamBuf>
+class LineStream: public std::ostream {
+public:
+  /**
+   * @brief Whether the std::streambuf was opened successfully.
+   */
+  bool is_open() const { return m_buf.is_open(); }
+
+protected:
+  /**
+   * @brief Constructor of the class.
+   * @param args The arguments of the constructor of the std::streambuf
+   */
+  template<typename... Args>
+  explicit LineStream(Args&&... args):
+    std::ostream{nullptr},
+    m_buf{std::forward<Args>(args)...}
+  {
+    rdbuf(&m_buf);
+  }
+
+  /**
+   * @brief Sets the failbit of the stream if the std::streambuf couldn't be opened. Called by
+   * the sinks which can't write anything in that case.
+   */
+  void check_open()
+  {
+    if (!m_buf.is_open()) {
+      setstate(std::ios_base::failbit);
+    }
+  }
+
+  /**
+   * @brief The std::streambuf of the stream.
+   */
+  StreamBuf m_buf;
+};
+
+} //namespace cc
+
+#endif //__CC_FORMAT_H__
@@ -0,0 +1,95 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include "log_context.hh"
+
+namespace cc {
+
+namespace {
+
+// Rendered as "[name] ", or empty
+thread_local std::string thread_name_tag;
+// All the key-values of the thread, rendered as "[key=value] [key=value] ". Each scope renders
+// its own copy, so captures share it without copying
+thread_local std::shared_ptr<const std::string> context_text;
+
+const std::string empty_text;
+
+} //namespace
+
+void set_log_thread_name(const std::string &name)
+{
+    thread_name_tag.clear();
+    if (!name.empty()) {
+        thread_name_tag.reserve(name.size() + 3);
+        thread_name_tag.push_back('[');
+        thread_name_tag.append(name);
+        thread_name_tag.append("] ");
+    }
+}
+
+std::string log_thread_name()
+{
+    if (thread_name_tag.empty()) {
+        return std::string{};
+    }
+    return thread_name_tag.substr(1, thread_name_tag.size() - 3);
+}
+
+LogContext capture_log_context()
+{
+    return LogContext{context_text};
+}
+
+void append_log_context(std::string &out)
+{
+    out.append(thread_name_tag);
+    if (context_text) {
+        out.append(*context_text);
+    }
+}
+
+//LogContext
+const std::string &LogContext::text() const
+{
+    return m_text ? *m_text : empty_text;
+}
+
+//ScopedLogContext
+ScopedLogContext::ScopedLogContext(const std::string &key, const std::string &value):
+    m_previous{context_text}
+{
+    std::shared_ptr<std::string> text = std::make_shared<std::string>();
+    const std::string &previous = m_previous.text();
+    text->reserve(previous.size() + key.size() + value.size() + 4);
+    text->append(previous);
+    text->push_back('[');
+    text->append(key);
+    text->push_back('=');
+    text->append(value);
+    text->append("] ");
+    context_text = std::move(text);
+}
+
+ScopedLogContext::~ScopedLogContext()
+{
+    context_text = std::move(m_previous.m_text);
+}
+
+//AdoptedLogContext
+AdoptedLogContext::AdoptedLogContext(const LogContext &context):
+    m_previous{context_text}
+{
+    context_text = context.m_text;
+}
+
+AdoptedLogContext::~AdoptedLogContext()
+{
+    context_text = std::move(m_previous.m_text);
+}
+
+} //namespace cc
@@ -0,0 +1,193 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#ifndef __CC_LOG_CONTEXT_H__
+#define __CC_LOG_CONTEXT_H__
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "format.hh"
+
+namespace cc {
+
+/**
+ * @brief Sets the name of the calling thread, rendered as `[name] ` after the severity of every
+ * line it logs. An empty name removes it.
+ */
+void set_log_thread_name(const std::string &name);
+
+/**
+ * @brief Name of the calling thread set with \ref set_log_thread_name.
+ */
+std::string log_thread_name();
+
+/**
+ * @brief Snapshot of the diagnostic context of a thread, to be adopted by another thread with
+ * \ref AdoptedLogContext. It's cheap to copy: the rendered text is shared, not copied.
+ */
+class LogContext final {
+public:
+  /**
+   * @brief Constructor of an empty context.
+   */
+  LogContext() = default;
+
+  /**
+   * @brief The rendered key-values, like `[req=42] [user=bob] `.
+   */
+  const std::string &text() const;
+  /**
+   * @brief Whether there are no key-values.
+   */
+  bool empty() const { return !m_text; }
+
+private:
+  explicit LogContext(std::shared_ptr<const std::string> text): m_text{std::move(text)} {}
+
+  std::shared_ptr<const std::string> m_text;
+
+  friend LogContext capture_log_context();
+  friend class ScopedLogContext;
+  friend class AdoptedLogContext;
+};
+
+/**
+ * @brief Captures the diagnostic context of the calling thread, typically before handing work
+ * off to another thread.
+ */
+LogContext capture_log_context();
+
+/**
+ * @brief Appends the thread name and the diagnostic context of the calling thread to a log line.
+ * Called by \ref Logger::log(LogSeverity sev) for the lines which pass the filter.
+ */
+void append_log_context(std::string &out);
+
+/**
+ * @brief Adds a key-value to the diagnostic context of the calling thread while the object lives:
+ *
+ * `cc::ScopedLogContext req{"req", request_id};`
+ *
+ * `cc::info_log() << "Started"; // [INFO ] [req=42] Started`
+ *
+ * The key-value is formatted once, when the scope is entered, and is copied into the lines which
+ * pass the filter. Objects must be destroyed in reverse order of creation, which is what
+ * automatic variables do.
+ */
+class ScopedLogContext final {
+public:
+  /**
+   * @brief Constructor of the class for string values.
+   * @param key The key
+   * @param value The value
+   */
+  ScopedLogContext(const std::string &key, const std::string &value);
+
+  /**
+   * @brief Constructor of the class for C string values.
+   * @param key The key
+   * @param value The value
+   */
+  ScopedLogContext(const std::string &key, const char *value):
+    ScopedLogContext{key, std::string{value != nullptr ? value : ""}} {}
+
+  /**
+   * @brief Constructor of the class for integer values.
+   * @tparam T The integral type of the value
+   * @param key The key
+   * @param value The value
+   */
+  template<typename T, typename std::enable_if<is_formattable_integer<T>::value, int>::type = 0>
+  ScopedLogContext(const std::string &key, T value):
+    ScopedLogContext{key, integer_text(value)} {}
+
+  /**
+   * @brief Constructor of the class for any other value, formatted with its std::ostream `<<`
+   * operator.
+   * @tparam T The type of the value
+   * @param key The key
+   * @param value The value
+   */
+  template<typename T, typename std::enable_if<!is_formattable_integer<T>::value &&
+    !std::is_convertible<const T&, std::string>::value, int>::type = 0>
+  ScopedLogContext(const std::string &key, const T &value):
+    ScopedLogContext{key, stream_text(value)} {}
+
+  /**
+   * @brief Class destructor. Restores the previous context.
+   */
+  ~ScopedLogContext();
+
+  /**
+   * @brief Deleted copy constructor
+   */
+  ScopedLogContext(const ScopedLogContext&) = delete;
+  /**
+   * @brief Deleted assignment operator
+   */
+  ScopedLogContext& operator=(const ScopedLogContext&) = delete;
+
+private:
+  template<typename T>
+  static std::string integer_text(T value) {
+    std::string text;
+    append_integer(text, value);
+    return text;
+  }
+
+  template<typename T>
+  static std::string stream_text(const T &value) {
+    std::ostringstream oss;
+    oss << value;
+    return oss.str();
+  }
+
+  LogContext m_previous;
+};
+
+/**
+ * @brief Installs a captured diagnostic context in the calling thread while the object lives,
+ * so the lines logged by a background thread carry the context of the work they do:
+ *
+ * `cc::LogContext ctx = cc::capture_log_context();`
+ *
+ * `pool.post([ctx]() { cc::AdoptedLogContext adopted{ctx}; cc::info_log() << "Done"; });`
+ *
+ * The thread name is not part of the context: lines keep the name of the thread logging them.
+ */
+class AdoptedLogContext final {
+public:
+  /**
+   * @brief Constructor of the class.
+   * @param context The context captured with \ref capture_log_context()
+   */
+  explicit AdoptedLogContext(const LogContext &context);
+  /**
+   * @brief Class destructor. Restores the previous context.
+   */
+  ~AdoptedLogContext();
+
+  /**
+   * @brief Deleted copy constructor
+   */
+  AdoptedLogContext(const AdoptedLogContext&) = delete;
+  /**
+   * @brief Deleted assignment operator
+   */
+  AdoptedLogContext& operator=(const AdoptedLogContext&) = delete;
+
+private:
+  LogContext m_previous;
+};
+
+} //namespace cc
+
+#endif //__CC_LOG_CONTEXT_H__
@@ -0,0 +1,253 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "format.hh"
+#include "log_index.hh"
+#include "logger.hh"
+
+namespace cc {
+
+namespace {
+
+const char index_magic[8] = {'C', 'C', 'L', 'O', 'G', 'I', 'D', 'X'};
+const std::uint32_t index_version = 1;
+const std::uint32_t index_entry_size = 64;
+const std::uint32_t index_flag_unknown = 1;
+
+template<typename T> char *put(char *p, T value)
+{
+    std::memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
+
+template<typename T> const char *get(const char *p, T &value)
+{
+    std::memcpy(&value, p, sizeof(value));
+    return p + sizeof(value);
+}
+
+void serialize(const LogIndexBlock &block, char *entry)
+{
+    std::memset(entry, 0, index_entry_size);
+    char *p = entry;
+    p = put(p, block.offset);
+    p = put(p, block.length);
+    p = put(p, block.min_micros);
+    p = put(p, block.max_micros);
+    p = put(p, block.lines);
+    for (std::size_t i = 0; i < log_severity_count; ++i) {
+        p = put(p, block.severity_counts[i]);
+    }
+    put(p, block.unknown ? index_flag_unknown : std::uint32_t{0});
+}
+
+void deserialize(const char *entry, LogIndexBlock &block)
+{
+    const char *p = entry;
+    p = get(p, block.offset);
+    p = get(p, block.length);
+    p = get(p, block.min_micros);
+    p = get(p, block.max_micros);
+    p = get(p, block.lines);
+    for (std::size_t i = 0; i < log_severity_count; ++i) {
+        p = get(p, block.severity_counts[i]);
+    }
+    std::uint32_t flags;
+    get(p, flags);
+    block.unknown = (flags & index_flag_unknown) != 0;
+}
+
+void write_header(std::ostream &os)
+{
+    char header[16];
+    std::memcpy(header, index_magic, sizeof(index_magic));
+    put(put(header + sizeof(index_magic), index_version), index_entry_size);
+    os.write(header, sizeof(header));
+}
+
+// Block covering bytes of the log file whose lines are not known, so it's never skipped
+LogIndexBlock unknown_block(std::uint64_t offset, std::uint64_t length)
+{
+    LogIndexBlock block;
+    block.offset = offset;
+    block.length = length;
+    block.min_micros = std::numeric_limits<std::int64_t>::min();
+    block.max_micros = std::numeric_limits<std::int64_t>::max();
+    block.unknown = true;
+    return block;
+}
+
+} //namespace
+
+bool read_log_index(const std::string &index_path, std::vector<LogIndexBlock> &blocks)
+{
+    blocks.clear();
+
+    std::ifstream ifs{index_path, std::ios_base::in | std::ios_base::binary};
+    char header[16];
+    if (!ifs.read(header, sizeof(header)) ||
+        (std::memcmp(header, index_magic, sizeof(index_magic)) != 0)) {
+        return false;
+    }
+    std::uint32_t version;
+    std::uint32_t entry_size;
+    get(get(header + sizeof(index_magic), version), entry_size);
+    if ((version != index_version) || (entry_size != index_entry_size)) {
+        return false;
+    }
+
+    // A partially written last entry is ignored
+    char entry[index_entry_size];
+    while (ifs.read(entry, sizeof(entry))) {
+        blocks.emplace_back();
+        deserialize(entry, blocks.back());
+    }
+    return true;
+}
+
+//IndexedFileStreamBuf
+IndexedFileStreamBuf::IndexedFileStreamBuf(const std::string &path, bool append,
+    std::size_t block_size):
+    m_log{},
+    m_index{},
+    m_block_size{block_size},
+    m_record{},
+    m_block{}
+{
+    const std::ios_base::openmode mode = std::ios_base::out | std::ios_base::binary |
+        (append ? std::ios_base::app : std::ios_base::trunc);
+    if (m_log.open(path, mode) == nullptr) {
+        return;
+    }
+
+    const std::streamoff end = m_log.pubseekoff(0, std::ios_base::end, std::ios_base::out);
+    std::uint64_t log_size = (end > 0) ? static_cast<std::uint64_t>(end) : 0;
+
+    // After a crash the last line can be incomplete. It's ended, so the new lines don't get
+    // glued to it. The new line character belongs to the block of unknown contents
+    if (log_size > 0) {
+        std::ifstream ifs{path, std::ios_base::binary};
+        ifs.seekg(-1, std::ios_base::end);
+        if (ifs.get() != '\n') {
+            m_log.sputc('\n');
+            ++log_size;
+        }
+    }
+    m_block.offset = log_size;
+
+    open_index(path + log_index_suffix, append, log_size);
+}
+
+IndexedFileStreamBuf::~IndexedFileStreamBuf()
+{
+    complete_last_line();
+    close_block();
+}
+
+void IndexedFileStreamBuf::open_index(const std::string &index_path, bool append,
+    std::uint64_t log_size)
+{
+    if (append) {
+        // Keep the existing index if it matches the file. Bytes written without index are
+        // described by a block of unknown contents
+        std::vector<LogIndexBlock> blocks;
+        if (read_log_index(index_path, blocks)) {
+            const std::uint64_t indexed = blocks.empty() ? 0 :
+                blocks.back().offset + blocks.back().length;
+            if (indexed <= log_size) {
+                // Drop a partially written last entry before appending
+                const std::uint64_t valid_size = 16 + blocks.size() * index_entry_size;
+                m_index.open(index_path, std::ios_base::in | std::ios_base::out |
+                    std::ios_base::binary);
+                m_index.seekp(static_cast<std::streamoff>(valid_size));
+                if (indexed < log_size) {
+                    write_index_entry(unknown_block(indexed, log_size - indexed));
+                }
+                return;
+            }
+        }
+    }
+
+    m_index.open(index_path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    write_header(m_index);
+    if (log_size > 0) {
+        write_index_entry(unknown_block(0, log_size));
+    }
+    m_index.flush();
+}
+
+int IndexedFileStreamBuf::sync()
+{
+    return m_log.pubsync();
+}
+
+void IndexedFileStreamBuf::complete_line(std::string &line)
+{
+    const std::int64_t micros = utc_now_micros();
+
+    m_record.clear();
+    append_utc_timestamp(m_record, micros);
+    m_record.push_back(' ');
+    m_record.append(line);
+    m_record.push_back('\n');
+    m_log.sputn(m_record.data(), static_cast<std::streamsize>(m_record.size()));
+
+    if (m_block.lines == 0) {
+        m_block.min_micros = micros;
+        m_block.max_micros = micros;
+    } else if (micros < m_block.min_micros) {
+        m_block.min_micros = micros;
+    } else if (micros > m_block.max_micros) {
+        m_block.max_micros = micros;
+    }
+    ++m_block.lines;
+    LogSeverity sev;
+    if (parse_severity_tag(line.data(), line.size(), sev)) {
+        ++m_block.severity_counts[static_cast<std::size_t>(sev)];
+    }
+    m_block.length += m_record.size();
+
+    if (m_block.length >= m_block_size) {
+        close_block();
+    }
+}
+
+void IndexedFileStreamBuf::close_block()
+{
+    if (m_block.lines == 0) {
+        return;
+    }
+
+    // The lines must be in the file before the index claims them
+    m_log.pubsync();
+    write_index_entry(m_block);
+    m_index.flush();
+
+    const std::uint64_t next_offset = m_block.offset + m_block.length;
+    m_block = LogIndexBlock{};
+    m_block.offset = next_offset;
+}
+
+void IndexedFileStreamBuf::write_index_entry(const LogIndexBlock &block)
+{
+    char entry[index_entry_size];
+    serialize(block, entry);
+    m_index.write(entry, sizeof(entry));
+}
+
+//IndexedLogFile
+IndexedLogFile::IndexedLogFile(const std::string &path, bool append, std::size_t block_size):
+    LineStream<IndexedFileStreamBuf>{path, append, block_size}
+{
+    check_open();
+}
+
+} //namespace cc
@@ -0,0 +1,139 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#ifndef __CC_LOG_INDEX_H__
+#define __CC_LOG_INDEX_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "format.hh"
+
+namespace cc {
+
+/**
+ * @brief Number of severities counted by \ref LogIndexBlock, one per \ref LogSeverity value
+ */
+const std::size_t log_severity_count = 6;
+
+/**
+ * @brief Entry of the sidecar index of a log file, describing a block of whole lines.
+ *
+ * The index file starts with the 8 bytes `CCLOGIDX`, a 32 bits version and a 32 bits entry size,
+ * followed by one entry per block. All the fields are stored in the native byte order.
+ */
+struct LogIndexBlock {
+  /** Offset of the first byte of the block in the log file */
+  std::uint64_t offset{0};
+  /** Length of the block in bytes */
+  std::uint64_t length{0};
+  /** Lowest timestamp of the lines of the block, in microseconds since the Unix epoch */
+  std::int64_t min_micros{0};
+  /** Highest timestamp of the lines of the block, in microseconds since the Unix epoch */
+  std::int64_t max_micros{0};
+  /** Number of lines of the block */
+  std::uint32_t lines{0};
+  /** Number of lines of each severity, indexed by the \ref LogSeverity value */
+  std::uint32_t severity_counts[log_severity_count]{};
+  /** True when the contents of the block are unknown, e.g. lines written without index */
+  bool unknown{false};
+};
+
+/**
+ * @brief Suffix appended to the log file path to name its sidecar index
+ */
+const char log_index_suffix[] = ".idx";
+
+/**
+ * @brief Reads the sidecar index of a log file.
+ * @param index_path The path of the index file
+ * @param blocks Where the entries of the index are stored
+ * @return False if the file can't be read or it's not a log index
+ */
+bool read_log_index(const std::string &index_path, std::vector<LogIndexBlock> &blocks);
+
+/**
+ * @brief std::streambuf writing log lines to a file, prefixed by a UTC timestamp, and keeping
+ * a sidecar index of the file.
+ *
+ * The file is split in blocks of about the configured size, always ending at a line boundary.
+ * When a block is complete, its offset, length, time range and number of lines of each severity
+ * are appended to the index, which is the file path followed by \ref log_index_suffix.
+ * The block being written is not in the index yet, so readers must scan the end of the file not
+ * covered by it.
+ */
+class IndexedFileStreamBuf final: public LineStreamBuf {
+public:
+  /**
+   * @brief Constructor of the class. It opens the log file and its index.
+   * @param path The path of the log file
+   * @param append Whether to append to an existing file instead of truncating it
+   * @param block_size The size of the blocks described by the index
+   */
+  IndexedFileStreamBuf(const std::string &path, bool append, std::size_t block_size);
+  /**
+   * @brief Class destructor. Writes the pending line and indexes the last block.
+   */
+  ~IndexedFileStreamBuf();
+
+  /**
+   * @brief Deleted copy constructor
+   */
+  IndexedFileStreamBuf(const IndexedFileStreamBuf&) = delete;
+  /**
+   * @brief Deleted assignment operator
+   */
+  IndexedFileStreamBuf& operator=(const IndexedFileStreamBuf&) = delete;
+
+  /**
+   * @brief Whether the log file and its index were opened successfully.
+   */
+  bool is_open() const { return m_log.is_open() && m_index.is_open(); }
+
+protected:
+  int sync() override;
+  void complete_line(std::string &line) override;
+
+private:
+  void close_block();
+  void write_index_entry(const LogIndexBlock &block);
+  void open_index(const std::string &index_path, bool append, std::uint64_t log_size);
+
+  std::filebuf m_log;
+  std::ofstream m_index;
+  const std::size_t m_block_size;
+  std::string m_record;
+  LogIndexBlock m_block;
+};
+
+/**
+ * @brief std::ostream writing an indexed log file, which can be searched quickly with the
+ * `cc_log_query` tool:
+ *
+ * `cc::IndexedLogFile log_file{"app.log"};`
+ *
+ * If the file or its index can't be opened the failbit of the stream is set.
+ * @sa IndexedFileStreamBuf
+ */
+class IndexedLogFile final: public LineStream<IndexedFileStreamBuf> {
+public:
+  /**
+   * @brief Constructor of the class.
+   * @param path The path of the log file. The index is written next to it
+   * @param append Whether to append to an existing file instead of truncating it
+   * @param block_size The size of the blocks described by the index
+   */
+  explicit IndexedLogFile(const std::string &path, bool append = false,
+    std::size_t block_size = 1 << 20);
+};
+
+} //namespace cc
+
+#endif //__CC_LOG_INDEX_H__
@@ -0,0 +1,310 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "format.hh"
+#include "log_index.hh"
+#include "log_query.hh"
+
+namespace cc {
+
+namespace {
+
+// Size of the pieces in which the parts of the file not covered by the index are searched
+const std::uint64_t chunk_size = 1 << 20;
+
+class MappedFile final {
+public:
+    explicit MappedFile(const std::string &path): m_fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)},
+        m_data{nullptr}, m_size{0} {
+        struct stat st;
+        if ((m_fd < 0) || (::fstat(m_fd, &st) != 0)) {
+            return;
+        }
+        m_size = static_cast<std::uint64_t>(st.st_size);
+        if (m_size == 0) {
+            return;
+        }
+        void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (data == MAP_FAILED) {
+            m_size = 0;
+            ::close(m_fd);
+            m_fd = -1;
+            return;
+        }
+        m_data = static_cast<const char *>(data);
+    }
+    ~MappedFile() {
+        if (m_data != nullptr) {
+            ::munmap(const_cast<char *>(m_data), m_size);
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return m_fd >= 0; }
+    const char *data() const { return m_data; }
+    std::uint64_t size() const { return m_size; }
+
+private:
+    int m_fd;
+    const char *m_data;
+    std::uint64_t m_size;
+};
+
+struct ScanRange {
+    std::uint64_t begin;
+    std::uint64_t end;
+};
+
+bool has_time_filter(const LogQuery &query)
+{
+    return (query.from_micros != std::numeric_limits<std::int64_t>::min()) ||
+        (query.to_micros != std::numeric_limits<std::int64_t>::max());
+}
+
+bool has_severity_filter(const LogQuery &query)
+{
+    return query.min_severity > LogSeverity::TRACE;
+}
+
+bool block_may_match(const LogIndexBlock &block, const LogQuery &query)
+{
+    if (block.unknown) {
+        return true;
+    }
+    if ((block.max_micros < query.from_micros) || (block.min_micros > query.to_micros)) {
+        return false;
+    }
+    if (has_severity_filter(query)) {
+        std::uint64_t lines = 0;
+        for (std::size_t s = static_cast<std::size_t>(query.min_severity); s < log_severity_count; ++s) {
+            lines += block.severity_counts[s];
+        }
+        return lines > 0;
+    }
+    return true;
+}
+
+// Splits [begin, end) in pieces of about chunk_size, ending at line boundaries
+void add_ranges(const char *data, std::uint64_t begin, std::uint64_t end,
+    std::vector<ScanRange> &ranges)
+{
+    while (begin < end) {
+        std::uint64_t cut = begin + chunk_size;
+        if (cut >= end) {
+            cut = end;
+        } else {
+            const void *nl = std::memchr(data + cut, '\n', end - cut);
+            cut = (nl == nullptr) ? end : static_cast<const char *>(nl) - data + 1;
+        }
+        ranges.push_back(ScanRange{begin, cut});
+        begin = cut;
+    }
+}
+
+bool line_passes_filters(const char *line, std::size_t len, const LogQuery &query)
+{
+    const bool time_filter = has_time_filter(query);
+    const bool severity_filter = has_severity_filter(query);
+    if (!time_filter && !severity_filter) {
+        return true;
+    }
+
+    std::int64_t micros = 0;
+    const std::size_t ts_len = parse_utc_timestamp(line, len, micros);
+    if (time_filter &&
+        ((ts_len == 0) || (micros < query.from_micros) || (micros > query.to_micros))) {
+        return false;
+    }
+    if (severity_filter) {
+        const std::size_t pos = (ts_len > 0) ? ts_len + 1 : 0;
+        LogSeverity sev;
+        if ((pos > len) || !parse_severity_tag(line + pos, len - pos, sev) ||
+            (sev < query.min_severity)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void scan_range(const char *begin, const char *end, const LogQuery &query, std::string &result,
+    std::uint64_t &matches)
+{
+    const char *p = begin;
+    while (p < end) {
+        const char *line = p;
+        const char *line_end;
+
+        if (query.pattern.empty()) {
+            line_end = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        } else {
+            const char *hit = find_substring(p, end - p, query.pattern.data(), query.pattern.size());
+            if (hit == nullptr) {
+                return;
+            }
+            // Ranges start at line boundaries, so the search backwards is bounded
+            const void *prev_nl = ::memrchr(p, '\n', hit - p);
+            line = (prev_nl == nullptr) ? p : static_cast<const char *>(prev_nl) + 1;
+            line_end = static_cast<const char *>(std::memchr(hit, '\n', end - hit));
+        }
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+
+        if (line_passes_filters(line, line_end - line, query)) {
+            ++matches;
+            if (!query.count_only) {
+                result.append(line, line_end);
+                result.push_back('\n');
+            }
+        }
+        p = line_end + 1;
+    }
+}
+
+} //namespace
+
+const char *find_substring(const char *haystack, std::size_t haystack_len,
+    const char *needle, std::size_t needle_len)
+{
+    if (needle_len == 0) {
+        return haystack;
+    }
+    if (needle_len > haystack_len) {
+        return nullptr;
+    }
+    if (needle_len == 1) {
+        return static_cast<const char *>(std::memchr(haystack, needle[0], haystack_len));
+    }
+
+    const std::size_t last = needle_len - 1;
+    const std::size_t positions = haystack_len - last;
+    std::size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i first_char = _mm_set1_epi8(needle[0]);
+    const __m128i last_char = _mm_set1_epi8(needle[last]);
+    for (; i + 16 <= positions; i += 16) {
+        const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i));
+        const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(haystack + i + last));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(block_first, first_char), _mm_cmpeq_epi8(block_last, last_char))));
+        while (mask != 0) {
+            const unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+            if (std::memcmp(haystack + i + bit + 1, needle + 1, needle_len - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < positions; ++i) {
+        if ((haystack[i] == needle[0]) && (haystack[i + last] == needle[last]) &&
+            (std::memcmp(haystack + i + 1, needle + 1, needle_len - 2) == 0)) {
+            return haystack + i;
+        }
+    }
+    return nullptr;
+}
+
+bool query_log(const std::string &path, const LogQuery &query, std::ostream &out,
+    LogQueryStats &stats)
+{
+    stats = LogQueryStats{};
+
+    MappedFile file{path};
+    if (!file.is_open()) {
+        return false;
+    }
+
+    // Select the blocks which may match. The end of the file not in the index is always searched
+    std::vector<LogIndexBlock> blocks;
+    read_log_index(path + log_index_suffix, blocks);
+
+    std::vector<ScanRange> ranges;
+    std::uint64_t indexed = 0;
+    for (const auto &block: blocks) {
+        if ((block.offset != indexed) || (block.offset + block.length > file.size())) {
+            break;
+        }
+        indexed = block.offset + block.length;
+        ++stats.blocks;
+        if (block_may_match(block, query)) {
+            add_ranges(file.data(), block.offset, indexed, ranges);
+        } else {
+            ++stats.skipped_blocks;
+        }
+    }
+    if (indexed < file.size()) {
+        ++stats.blocks;
+        add_ranges(file.data(), indexed, file.size(), ranges);
+    }
+
+    unsigned threads = (query.threads > 0) ? query.threads : std::thread::hardware_concurrency();
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    // Ranges are searched in windows, so the results are written in order without keeping the
+    // results of the whole file in memory
+    const std::size_t window = static_cast<std::size_t>(threads) * 4;
+    std::vector<std::string> results;
+    std::vector<std::uint64_t> matches;
+    for (std::size_t first = 0; first < ranges.size(); first += window) {
+        const std::size_t count = std::min(window, ranges.size() - first);
+        results.assign(count, std::string{});
+        matches.assign(count, 0);
+        std::atomic<std::size_t> next{0};
+
+        auto worker = [&]() {
+            for (std::size_t i = next++; i < count; i = next++) {
+                const ScanRange &range = ranges[first + i];
+                scan_range(file.data() + range.begin, file.data() + range.end, query,
+                    results[i], matches[i]);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        const unsigned workers = static_cast<unsigned>(std::min<std::size_t>(threads, count));
+        for (unsigned t = 1; t < workers; ++t) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread: pool) {
+            thread.join();
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            stats.scanned_bytes += ranges[first + i].end - ranges[first + i].begin;
+            stats.matches += matches[i];
+            out.write(results[i].data(), static_cast<std::streamsize>(results[i].size()));
+        }
+    }
+
+    return true;
+}
+
+} //namespace cc
@@ -0,0 +1,85 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#ifndef __CC_LOG_QUERY_H__
+#define __CC_LOG_QUERY_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+
+#include "logger.hh"
+
+namespace cc {
+
+/**
+ * @brief Search criteria for \ref query_log
+ */
+struct LogQuery {
+  /** Text the lines must contain. Empty matches every line */
+  std::string pattern{};
+  /** Lowest timestamp of the lines, in microseconds since the Unix epoch */
+  std::int64_t from_micros{std::numeric_limits<std::int64_t>::min()};
+  /** Highest timestamp of the lines, in microseconds since the Unix epoch */
+  std::int64_t to_micros{std::numeric_limits<std::int64_t>::max()};
+  /** Lowest severity of the lines */
+  LogSeverity min_severity{LogSeverity::TRACE};
+  /** Number of threads searching. 0 means one per hardware thread */
+  unsigned threads{0};
+  /** Only count the matching lines, without writing them */
+  bool count_only{false};
+};
+
+/**
+ * @brief Statistics of a \ref query_log call
+ */
+struct LogQueryStats {
+  /** Number of blocks of the log file */
+  std::uint64_t blocks{0};
+  /** Number of blocks skipped thanks to the index */
+  std::uint64_t skipped_blocks{0};
+  /** Number of bytes searched */
+  std::uint64_t scanned_bytes{0};
+  /** Number of matching lines */
+  std::uint64_t matches{0};
+};
+
+/**
+ * @brief Finds the first occurrence of a string in a memory buffer.
+ *
+ * On x86 it compares the first and last characters of the needle at 16 positions per step with
+ * SSE2, and only checks the whole needle where both match.
+ * @param haystack The buffer to search
+ * @param haystack_len The length of the buffer
+ * @param needle The string to find
+ * @param needle_len The length of the string
+ * @return A pointer to the first occurrence, or nullptr if there isn't any
+ */
+const char *find_substring(const char *haystack, std::size_t haystack_len,
+  const char *needle, std::size_t needle_len);
+
+/**
+ * @brief Searches a log file written by \ref IndexedLogFile.
+ *
+ * The file is memory mapped. Blocks whose time range or severity counts in the index can't match
+ * the query are skipped, and the rest of the blocks, including the end of the file not covered
+ * by the index, are searched in parallel. The matching lines are written in file order.
+ * Files without index are searched entirely.
+ * @param path The path of the log file
+ * @param query The search criteria
+ * @param out Where the matching lines are written
+ * @param stats Where the statistics of the search are stored
+ * @return False if the log file can't be opened
+ */
+bool query_log(const std::string &path, const LogQuery &query, std::ostream &out,
+  LogQueryStats &stats);
+
+} //namespace cc
+
+#endif //__CC_LOG_QUERY_H__
@@ -6,6 +6,8 @@ This source code is licensed under the BSD-style license found in the
 LICENSE file in the root directory of this source tree.
 **********************************************************************/
 #include <cassert>
+#include <cstring>
+#include <locale>
 #include <mutex>
 
 #include "logger.hh"
@@ -28,17 +30,29 @@ Logger &SingletonLogger::instance(std::ostream *os, LogSeverity sev)
 }
 
 //LoggerDelegate
-LoggerDelegate::LoggerDelegate(std::ostream &os, const std::string &preamble, bool empty):
+LoggerDelegate::LoggerDelegate(std::ostream &os, const std::string &preamble, bool empty,
+    bool classic_locale):
     m_os{os},
-    m_preamble{preamble},
-    m_ss{},
+    m_buffer{},
+    m_streambuf{m_buffer},
+    m_stream{},
+    m_classic_locale{classic_locale},
     m_empty{empty}
-{}
+{
+    if (m_empty) {
+        return;
+    }
+
+    m_buffer.reserve(preamble.size() + 120);
+    m_buffer.append(preamble);
+}
 
 LoggerDelegate::LoggerDelegate(LoggerDelegate&& other):
     m_os{other.m_os},
-    m_preamble{other.m_preamble},
-    m_ss{},
+    m_buffer{},
+    m_streambuf{m_buffer},
+    m_stream{},
+    m_classic_locale{false},
     m_empty{other.m_empty}
 {
     assert(false && "LoggerDelegate's move constructor shouldn't have been called!");
@@ -52,15 +66,122 @@ LoggerDelegate::~LoggerDelegate()
 
     {
         const std::lock_guard<std::mutex> lock(mut);
-        m_os << m_preamble << m_ss.str() << std::endl;
+        m_os.write(m_buffer.data(), m_buffer.size()) << std::endl;
+    }
+}
+
+LoggerDelegate &LoggerDelegate::operator<<(const char *rhs)
+{
+    if (!m_empty) {
+        if ((rhs != nullptr) && (!m_stream || (m_stream->width() == 0))) {
+            m_buffer.append(rhs);
+        } else {
+            stream() << rhs;
+        }
+    }
+    return *this;
+}
+
+LoggerDelegate &LoggerDelegate::operator<<(const std::string &rhs)
+{
+    if (!m_empty) {
+        if (!m_stream || (m_stream->width() == 0)) {
+            m_buffer.append(rhs);
+        } else {
+            stream() << rhs;
+        }
+    }
+    return *this;
+}
+
+LoggerDelegate &LoggerDelegate::operator<<(const HexDump &rhs)
+{
+    if (!m_empty) {
+        if (!m_stream || (m_stream->width() == 0)) {
+            append_encoded(m_buffer, rhs);
+        } else {
+            stream() << rhs;
+        }
+    }
+    return *this;
+}
+
+LoggerDelegate &LoggerDelegate::operator<<(const Base64 &rhs)
+{
+    if (!m_empty) {
+        if (!m_stream || (m_stream->width() == 0)) {
+            append_encoded(m_buffer, rhs);
+        } else {
+            stream() << rhs;
+        }
     }
+    return *this;
+}
+
+LoggerDelegate &LoggerDelegate::operator<<(std::ostream &(*manip)(std::ostream &))
+{
+    if (!m_empty) {
+        manip(stream());
+    }
+    return *this;
+}
+
+std::ostream &LoggerDelegate::stream()
+{
+    if (!m_stream) {
+        m_stream.reset(new std::ostream{&m_streambuf});
+        // Same locale as the fast paths, even if the global one changed after the Logger was built
+        if (m_classic_locale) {
+            m_stream->imbue(std::locale::classic());
+        }
+    }
+    return *m_stream;
+}
+
+std::ios_base::fmtflags LoggerDelegate::flags() const
+{
+    return m_stream ? m_stream->flags() : (std::ios_base::dec | std::ios_base::skipws);
+}
+
+std::streamsize LoggerDelegate::precision() const
+{
+    return m_stream ? m_stream->precision() : 6;
+}
+
+bool LoggerDelegate::is_plain_integer_format() const
+{
+    if (!m_classic_locale) {
+        return false;
+    }
+    if (!m_stream) {
+        return true;
+    }
+
+    const std::ios_base::fmtflags base = m_stream->flags() & std::ios_base::basefield;
+    return ((base == std::ios_base::dec) || (base == std::ios_base::fmtflags{})) &&
+        !(m_stream->flags() & std::ios_base::showpos) &&
+        (m_stream->width() == 0);
+}
+
+bool LoggerDelegate::is_plain_floating_format() const
+{
+    if (!m_classic_locale) {
+        return false;
+    }
+    if (!m_stream) {
+        return true;
+    }
+
+    const std::ios_base::fmtflags floatfield = m_stream->flags() & std::ios_base::floatfield;
+    return (floatfield != std::ios_base::floatfield) && (m_stream->width() == 0);
 }
 
 // Logger
 Logger::Logger(std::ostream &os, LogSeverity sev):
     m_dummy_ss{},
     m_os{os},
-    m_sev_filter{sev}
+    m_sev_filter{sev},
+    m_classic_locale{std::locale() == std::locale::classic()}
 {}
 
 std::string Logger::LogSeverityText(LogSeverity sev)
@@ -80,13 +201,39 @@ std::string Logger::LogSeverityText(LogSeverity sev)
 LoggerDelegate Logger::log(LogSeverity sev)
 {
     if (sev >= m_sev_filter) {
-        return LoggerDelegate{m_os, std::string("[") + LogSeverityText(sev).substr(0, 5) + "] "};
+        // The diagnostic context is only looked up for the lines which pass the filter
+        std::string preamble = std::string("[") + LogSeverityText(sev).substr(0, 5) + "] ";
+        append_log_context(preamble);
+        return LoggerDelegate{m_os, preamble, false, m_classic_locale};
     }
 
     return LoggerDelegate{m_os, "", true};
 }
 
 //Helper functions
+bool parse_severity_tag(const char *s, std::size_t len, LogSeverity &sev)
+{
+    static const struct {
+        const char *tag;
+        LogSeverity sev;
+    } tags[] = {
+        {"[TRACE] ", LogSeverity::TRACE}, {"[DEBUG] ", LogSeverity::DEBUG},
+        {"[INFO ] ", LogSeverity::INFO}, {"[WARN ] ", LogSeverity::WARN},
+        {"[ERROR] ", LogSeverity::ERROR}, {"[FATAL] ", LogSeverity::FATAL}
+    };
+
+    if ((len < severity_tag_length) || (s[0] != '[')) {
+        return false;
+    }
+    for (const auto &tag: tags) {
+        if (std::memcmp(s, tag.tag, severity_tag_length) == 0) {
+            sev = tag.sev;
+            return true;
+        }
+    }
+    return false;
+}
+
 void configure_logger(std::ostream &os, LogSeverity sev)
 {
   SingletonLogger::instance(&os, sev);
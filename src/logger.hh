@@ -12,6 +12,14 @@ LICENSE file in the root directory of this source tree.
 #include <ostream>
 #include <sstream>
 #include <atomic>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "encode.hh"
+#include "format.hh"
+#include "log_context.hh"
 
 namespace cc {
 
@@ -27,9 +35,31 @@ enum class LogSeverity {
   FATAL /**< Used for fatal errors */
 };
 
+/**
+ * @brief Trait telling whether \ref LoggerDelegate formats a type itself, without going through
+ * std::ostream.
+ *
+ * Numbers, strings and binary buffers are appended directly to the message buffer. Any other
+ * type is inserted using its std::ostream `<<` operator.
+ * @tparam T The type to check. It must already be decayed.
+ */
+template<typename T> struct is_fast_formattable: std::integral_constant<bool,
+  is_formattable_integer<T>::value ||
+  std::is_floating_point<T>::value ||
+  std::is_same<T, char *>::value ||
+  std::is_same<T, const char *>::value ||
+  std::is_same<T, std::string>::value ||
+  std::is_same<T, HexDump>::value ||
+  std::is_same<T, Base64>::value> {};
+
 /**
  * @brief Class used to output the accumulated string, formed after chaining the << operators,
  * to the std::ostream used for log.
+ *
+ * Integers, floating point numbers and strings are appended straight to the message buffer.
+ * The std::ostream used for other types is only created when it is first needed, and its format
+ * state (std::hex, std::setw, std::fixed, std::setprecision...) is honoured by the fast paths,
+ * falling back to the std::ostream when they can't reproduce its output.
  */
 class LoggerDelegate final {
 public:
@@ -40,8 +70,11 @@ public:
    * @param preamble The preamble to be inserted before the log line
    * @param empty Indicates whether this instance generates output. It doesn't generate output
    * when the log has been filtered out
+   * @param classic_locale Whether the global locale is the classic one. The fast formatting
+   * paths reproduce std::num_put output for the classic locale only
    */
-  LoggerDelegate(std::ostream &os, const std::string &preamble, bool empty = false);
+  LoggerDelegate(std::ostream &os, const std::string &preamble, bool empty = false,
+    bool classic_locale = true);
 
   /**
    * @brief Class destructor. Outputs the accumulated string to the std::ostream object configured
@@ -53,13 +86,91 @@ public:
    * @brief Stream insertion operator overloading
    * @tparam T The type of the object used as RHS of the operator
    * @param rhs The RHS of the operator
-   * @return A reference to the std::ostream object used for acumulate the message.
+   * @return A reference to this object, to chain more insertions.
+   */
+  template<typename T>
+  typename std::enable_if<!is_fast_formattable<typename std::decay<T>::type>::value,
+    LoggerDelegate &>::type operator<<(T&& rhs) {
+    if (!m_empty) {
+      stream() << std::forward<T>(rhs);
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Stream insertion operator overloading for integers
+   * @tparam T The integral type of the RHS
+   * @param rhs The RHS of the operator
+   * @return A reference to this object, to chain more insertions.
+   */
+  template<typename T>
+  typename std::enable_if<is_formattable_integer<T>::value, LoggerDelegate &>::type
+  operator<<(T rhs) {
+    if (!m_empty) {
+      if (is_plain_integer_format()) {
+        append_integer(m_buffer, rhs);
+      } else {
+        stream() << rhs;
+      }
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Stream insertion operator overloading for floating point numbers
+   * @tparam T The floating point type of the RHS
+   * @param rhs The RHS of the operator
+   * @return A reference to this object, to chain more insertions.
    */
-  template<typename T> std::ostream &operator<<(T&& rhs) {
-    m_ss << std::forward<T>(rhs);
-    return m_ss;
+  template<typename T>
+  typename std::enable_if<std::is_floating_point<T>::value, LoggerDelegate &>::type
+  operator<<(T rhs) {
+    if (!m_empty) {
+      if (is_plain_floating_format()) {
+        append_floating(m_buffer, promote_floating(rhs), flags(), precision());
+      } else {
+        stream() << rhs;
+      }
+    }
+    return *this;
   }
 
+  /**
+   * @brief Stream insertion operator overloading for C strings
+   * @param rhs The RHS of the operator
+   * @return A reference to this object, to chain more insertions.
+   */
+  LoggerDelegate &operator<<(const char *rhs);
+
+  /**
+   * @brief Stream insertion operator overloading for std::string
+   * @param rhs The RHS of the operator
+   * @return A reference to this object, to chain more insertions.
+   */
+  LoggerDelegate &operator<<(const std::string &rhs);
+
+  /**
+   * @brief Stream insertion operator overloading for binary buffers in hexadecimal
+   * @param rhs The RHS of the operator, created with \ref hexdump
+   * @return A reference to this object, to chain more insertions.
+   */
+  LoggerDelegate &operator<<(const HexDump &rhs);
+
+  /**
+   * @brief Stream insertion operator overloading for binary buffers in base64
+   * @param rhs The RHS of the operator, created with \ref base64
+   * @return A reference to this object, to chain more insertions.
+   */
+  LoggerDelegate &operator<<(const Base64 &rhs);
+
+  /**
+   * @brief Stream insertion operator overloading for std::ostream manipulators, like std::endl
+   * or std::flush, which being templates can't be deduced by the generic overload.
+   * @param manip The manipulator
+   * @return A reference to this object, to chain more insertions.
+   */
+  LoggerDelegate &operator<<(std::ostream &(*manip)(std::ostream &));
+
   /**
    * @brief Deleted class copy constructor.
    */
@@ -79,9 +190,21 @@ public:
   LoggerDelegate& operator=(LoggerDelegate&&) = delete;
 
 private:
+  std::ostream &stream();
+  std::ios_base::fmtflags flags() const;
+  std::streamsize precision() const;
+  bool is_plain_integer_format() const;
+  bool is_plain_floating_format() const;
+
+  static double promote_floating(float value) { return value; }
+  static double promote_floating(double value) { return value; }
+  static long double promote_floating(long double value) { return value; }
+
   std::ostream &m_os;
-  std::string m_preamble;
-  std::stringstream m_ss;
+  std::string m_buffer;
+  MessageStreamBuf m_streambuf;
+  std::unique_ptr<std::ostream> m_stream;
+  bool m_classic_locale;
   const bool m_empty;
 };
 
@@ -101,6 +224,10 @@ public:
    * std::ofstream, etc
    * @param sev The log level to filter out log messages. Only log messages with a severity
    * equal or higher will be emitted.
+   *
+   * Whether the global locale is the classic one is checked here, once. Numbers are formatted
+   * with the global locale only if it was already set when the Logger was constructed.
+   * Otherwise all the numbers of a line use the classic locale, whichever path formats them.
    */
   Logger(std::ostream& os, LogSeverity sev);
   /**
@@ -132,6 +259,9 @@ public:
    * 
    * cc::SingletonLogger::instance().log(cc::LogSeverity::INFO) << "Temp: " << temp << " celcius";
    * 
+   * The thread name and the diagnostic context of the calling thread, see \ref ScopedLogContext,
+   * are inserted after the severity.
+   * 
    * @param sev The severity of the message. No message will be issued if is not severe enough
    * according to the severity filter configured in
    * \ref Logger(std::ostream& os, LogSeverity sev)
@@ -144,6 +274,7 @@ private:
   std::stringstream m_dummy_ss;
   std::ostream &m_os;
   const LogSeverity m_sev_filter;
+  const bool m_classic_locale;
 };
 
 /**
@@ -250,6 +381,23 @@ LoggerDelegate error_log();
  */
 LoggerDelegate fatal_log();
 
+/**
+ * @brief Length of the severity tag the logger writes at the beginning of each line, like
+ * `[INFO ] `
+ */
+const std::size_t severity_tag_length = 8;
+
+/**
+ * @brief Parses the severity tag the logger writes at the beginning of each line.
+ *
+ * It's used by the sinks which need to know the severity of the lines they receive.
+ * @param s The beginning of the line
+ * @param len The length of the line
+ * @param sev Where the parsed severity is stored
+ * @return True if the line starts with a severity tag
+ */
+bool parse_severity_tag(const char *s, std::size_t len, LogSeverity &sev);
+
 } //namespace cc
 
 #endif //__CC_LOGGER_H__
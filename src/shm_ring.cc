@@ -0,0 +1,509 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "format.hh"
+#include "shm_ring.hh"
+
+namespace cc {
+
+namespace {
+
+const std::uint64_t shm_ring_magic = 0x474e4952474f4c43ULL; // "CLOGRING"
+const std::uint32_t shm_ring_version = 1;
+const std::size_t cache_line = 64;
+const std::size_t no_region = std::numeric_limits<std::size_t>::max();
+// Value of Region::low_seq when the producer is not writing a record
+const std::uint64_t idle_seq = std::numeric_limits<std::uint64_t>::max();
+const std::size_t slot_header_size = 16;
+
+std::size_t round_up(std::size_t n)
+{
+    return (n + cache_line - 1) / cache_line * cache_line;
+}
+
+bool process_exists(int pid)
+{
+    return (::kill(pid, 0) == 0) || (errno != ESRCH);
+}
+
+} //namespace
+
+// Layout of the segment: the header, the producer regions, then the slots of each producer.
+// Only lock-free atomics of fixed size are used, so they work across processes
+struct alignas(64) ShmLogRing::Header {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t producers;
+    std::uint32_t slots;
+    std::uint32_t slot_size;
+    std::atomic<std::uint32_t> ready;
+    // Sequence number of the next record, shared by all the producers
+    std::atomic<std::uint64_t> next_seq;
+};
+
+struct alignas(64) ShmLogRing::Region {
+    // Process id of the producer, 0 when free
+    std::atomic<std::int32_t> owner;
+    // Lower bound of the sequence number of the record being written, or idle_seq
+    std::atomic<std::uint64_t> low_seq;
+    // Records committed by the producer
+    std::atomic<std::uint64_t> head;
+    // Records consumed by the collector
+    std::atomic<std::uint64_t> tail;
+    std::atomic<std::uint64_t> dropped;
+    std::atomic<std::uint64_t> truncated;
+};
+
+struct ShmLogRing::Slot {
+    std::uint64_t seq;
+    std::uint32_t len;
+    std::uint32_t unused;
+};
+
+namespace {
+
+std::size_t slot_stride(std::size_t slot_size)
+{
+    return round_up(slot_header_size + slot_size);
+}
+
+std::size_t segment_size(std::size_t producers, std::size_t slots, std::size_t slot_size)
+{
+    return cache_line + producers * cache_line + producers * slots * slot_stride(slot_size);
+}
+
+} //namespace
+
+//ShmLogRing
+ShmLogRing::ShmLogRing(const std::string &name, ShmRingMode mode,
+    const ShmRingOptions &options):
+    m_name{name},
+    m_base{nullptr},
+    m_size{0},
+    m_header{nullptr},
+    m_region{no_region},
+    m_pid{0},
+    m_stall_timeout{options.stall_timeout}
+{
+    const bool ok = (mode == ShmRingMode::CREATE) ? create(name, options) : attach(name);
+    if (!ok && (m_base != nullptr)) {
+        ::munmap(m_base, m_size);
+        m_base = nullptr;
+        m_header = nullptr;
+    }
+    if (m_header != nullptr) {
+        m_stalls.assign(m_header->producers, StallState{idle_seq, {}});
+    }
+}
+
+ShmLogRing::~ShmLogRing()
+{
+    detach_producer();
+    if (m_base != nullptr) {
+        ::munmap(m_base, m_size);
+    }
+}
+
+bool ShmLogRing::create(const std::string &name, const ShmRingOptions &options)
+{
+    if ((options.producers == 0) || (options.slots == 0) || (options.slot_size == 0) ||
+        (options.producers > std::numeric_limits<std::uint32_t>::max()) ||
+        (options.slots > std::numeric_limits<std::uint32_t>::max()) ||
+        (options.slot_size > std::numeric_limits<std::uint32_t>::max())) {
+        return false;
+    }
+    static_assert((sizeof(Header) == cache_line) && (sizeof(Region) == cache_line) &&
+        (sizeof(Slot) == slot_header_size), "Unexpected layout of the segment");
+    // Atomics which aren't lock-free use a lock table private to each process
+    static_assert((ATOMIC_INT_LOCK_FREE == 2) && (ATOMIC_LLONG_LOCK_FREE == 2),
+        "The shared memory ring needs lock-free 32 and 64 bit atomics");
+
+    // A segment left behind by a previous run is replaced, since its producers are gone
+    ::shm_unlink(name.c_str());
+    const int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    m_size = segment_size(options.producers, options.slots, options.slot_size);
+    if (::ftruncate(fd, static_cast<off_t>(m_size)) != 0) {
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+    void *base = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+    m_base = base;
+
+    // The new pages are zeroed
+    m_header = new (m_base) Header;
+    m_header->magic = shm_ring_magic;
+    m_header->version = shm_ring_version;
+    m_header->producers = static_cast<std::uint32_t>(options.producers);
+    m_header->slots = static_cast<std::uint32_t>(options.slots);
+    m_header->slot_size = static_cast<std::uint32_t>(options.slot_size);
+    m_header->next_seq.store(1);
+    for (std::size_t i = 0; i < options.producers; ++i) {
+        Region *r = new (region(i)) Region;
+        r->owner.store(0);
+        r->low_seq.store(idle_seq);
+        r->head.store(0);
+        r->tail.store(0);
+        r->dropped.store(0);
+        r->truncated.store(0);
+    }
+    m_header->ready.store(1, std::memory_order_release);
+    return true;
+}
+
+bool ShmLogRing::attach(const std::string &name)
+{
+    const int fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if ((::fstat(fd, &st) != 0) || (static_cast<std::size_t>(st.st_size) < sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+    m_size = static_cast<std::size_t>(st.st_size);
+    void *base = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    m_base = base;
+
+    Header *header = static_cast<Header *>(m_base);
+    if ((header->ready.load(std::memory_order_acquire) != 1) ||
+        (header->magic != shm_ring_magic) || (header->version != shm_ring_version) ||
+        (segment_size(header->producers, header->slots, header->slot_size) > m_size)) {
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+ShmLogRing::Region *ShmLogRing::region(std::size_t index) const
+{
+    return reinterpret_cast<Region *>(static_cast<char *>(m_base) + cache_line +
+        index * cache_line);
+}
+
+ShmLogRing::Slot *ShmLogRing::slot(std::size_t region_index, std::uint64_t record) const
+{
+    const std::size_t stride = slot_stride(m_header->slot_size);
+    const std::size_t index = region_index * m_header->slots + record % m_header->slots;
+    return reinterpret_cast<Slot *>(static_cast<char *>(m_base) + cache_line +
+        m_header->producers * cache_line + index * stride);
+}
+
+void ShmLogRing::unlink()
+{
+    ::shm_unlink(m_name.c_str());
+}
+
+bool ShmLogRing::attach_producer()
+{
+    if (m_header == nullptr) {
+        return false;
+    }
+    const int pid = ::getpid();
+    if (m_region != no_region) {
+        if (m_pid == pid) {
+            return true;
+        }
+        // Forked after claiming the region. It still belongs to the parent
+        m_region = no_region;
+    }
+
+    for (std::size_t i = 0; i < m_header->producers; ++i) {
+        Region *r = region(i);
+        std::int32_t expected = 0;
+        if (r->owner.compare_exchange_strong(expected, pid)) {
+            r->dropped.store(0, std::memory_order_relaxed);
+            r->truncated.store(0, std::memory_order_relaxed);
+            m_region = i;
+            m_pid = pid;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShmLogRing::detach_producer()
+{
+    if ((m_region == no_region) || (m_pid != ::getpid())) {
+        m_region = no_region;
+        return;
+    }
+    // The records not yet collected stay in the ring. The next owner appends after them
+    Region *r = region(m_region);
+    r->low_seq.store(idle_seq);
+    r->owner.store(0);
+    m_region = no_region;
+}
+
+char *ShmLogRing::begin_record(std::size_t &capacity)
+{
+    if (((m_region == no_region) || (m_pid != ::getpid())) && !attach_producer()) {
+        return nullptr;
+    }
+
+    Region *r = region(m_region);
+    const std::uint64_t head = r->head.load(std::memory_order_relaxed);
+    if (head - r->tail.load(std::memory_order_acquire) >= m_header->slots) {
+        r->dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    // Publish a lower bound before taking the number, so the collector never writes a later
+    // record before this one is committed
+    r->low_seq.store(m_header->next_seq.load());
+    Slot *s = slot(m_region, head);
+    s->seq = m_header->next_seq.fetch_add(1);
+    capacity = m_header->slot_size;
+    return reinterpret_cast<char *>(s) + sizeof(Slot);
+}
+
+void ShmLogRing::commit_record(std::size_t len)
+{
+    assert(m_region != no_region);
+    Region *r = region(m_region);
+    const std::uint64_t head = r->head.load(std::memory_order_relaxed);
+    slot(m_region, head)->len = static_cast<std::uint32_t>(std::min<std::size_t>(len,
+        m_header->slot_size));
+    r->head.store(head + 1, std::memory_order_release);
+    r->low_seq.store(idle_seq);
+}
+
+bool ShmLogRing::write_record(const char *data, std::size_t len)
+{
+    std::size_t capacity = 0;
+    char *dst = begin_record(capacity);
+    if (dst == nullptr) {
+        return false;
+    }
+    if (len <= capacity) {
+        std::memcpy(dst, data, len);
+        commit_record(len);
+        return true;
+    }
+
+    // Too long for a slot. It's cut so the marker fits, showing the record is incomplete
+    std::string marker{"... ("};
+    append_integer(marker, len);
+    marker.append(" bytes)");
+    if (marker.size() > capacity) {
+        marker.assign("...", std::min<std::size_t>(3, capacity));
+    }
+    const std::size_t kept = capacity - marker.size();
+    std::memcpy(dst, data, kept);
+    std::memcpy(dst + kept, marker.data(), marker.size());
+    commit_record(capacity);
+    region(m_region)->truncated.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool ShmLogRing::is_producer() const
+{
+    return (m_region != no_region) && (m_pid == ::getpid());
+}
+
+std::uint64_t ShmLogRing::dropped() const
+{
+    if (!is_producer()) {
+        return 0;
+    }
+    return region(m_region)->dropped.load(std::memory_order_relaxed);
+}
+
+std::uint64_t ShmLogRing::truncated() const
+{
+    if (!is_producer()) {
+        return 0;
+    }
+    return region(m_region)->truncated.load(std::memory_order_relaxed);
+}
+
+std::size_t ShmLogRing::active_producers() const
+{
+    std::size_t n = 0;
+    for (std::size_t i = 0; (m_header != nullptr) && (i < m_header->producers); ++i) {
+        if (region(i)->owner.load() != 0) {
+            ++n;
+        }
+    }
+    return n;
+}
+
+void ShmLogRing::drain(std::size_t region_index)
+{
+    Region *r = region(region_index);
+    const std::uint64_t head = r->head.load(std::memory_order_acquire);
+    const std::uint64_t tail = r->tail.load(std::memory_order_relaxed);
+    for (std::uint64_t i = tail; i < head; ++i) {
+        const Slot *s = slot(region_index, i);
+        const char *data = reinterpret_cast<const char *>(s) + sizeof(Slot);
+        m_held.push_back(Record{s->seq,
+            std::string(data, std::min<std::size_t>(s->len, m_header->slot_size))});
+    }
+    r->tail.store(head, std::memory_order_release);
+}
+
+void ShmLogRing::reclaim_dead_producers()
+{
+    for (std::size_t i = 0; i < m_header->producers; ++i) {
+        Region *r = region(i);
+        std::int32_t owner = r->owner.load();
+        if ((owner == 0) || process_exists(owner)) {
+            continue;
+        }
+        // Its committed records are kept. The one it was writing, if any, is lost
+        drain(i);
+        r->low_seq.store(idle_seq);
+        r->owner.compare_exchange_strong(owner, 0);
+    }
+}
+
+std::size_t ShmLogRing::collect(std::ostream &out, bool flush_all)
+{
+    if (m_header == nullptr) {
+        return 0;
+    }
+    reclaim_dead_producers();
+
+    // The order matters: the sequence is read before the lower bounds, and the records are
+    // gathered after them. A record not gathered now has a number above the watermark
+    std::uint64_t watermark = m_header->next_seq.load();
+    const auto now = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < m_header->producers; ++i) {
+        const std::uint64_t low_seq = region(i)->low_seq.load();
+        StallState &stall = m_stalls[i];
+        if (low_seq == idle_seq) {
+            stall.low_seq = idle_seq;
+            continue;
+        }
+        if (stall.low_seq != low_seq) {
+            stall = StallState{low_seq, now};
+        } else if (now - stall.since >= m_stall_timeout) {
+            // The producer hangs in the middle of a record. Stop waiting for it
+            continue;
+        }
+        watermark = std::min(watermark, low_seq);
+    }
+
+    for (std::size_t i = 0; i < m_header->producers; ++i) {
+        drain(i);
+    }
+
+    std::sort(m_held.begin(), m_held.end(), [](const Record &a, const Record &b) {
+        return a.seq < b.seq;
+    });
+    std::size_t n = 0;
+    while ((n < m_held.size()) && (flush_all || (m_held[n].seq < watermark))) {
+        out.write(m_held[n].text.data(), static_cast<std::streamsize>(m_held[n].text.size()));
+        out.put('\n');
+        ++n;
+    }
+    m_held.erase(m_held.begin(), m_held.begin() + static_cast<std::ptrdiff_t>(n));
+    if (n > 0) {
+        out.flush();
+    }
+    return n;
+}
+
+//ShmLogStreamBuf
+ShmLogStreamBuf::ShmLogStreamBuf(const std::string &name):
+    m_ring{name, ShmRingMode::ATTACH},
+    m_unclaimed_dropped{0}
+{
+    m_ring.attach_producer();
+}
+
+void ShmLogStreamBuf::complete_line(std::string &line)
+{
+    // Without a region, writing retries to claim one, like after a fork
+    if (!m_ring.write_record(line.data(), line.size()) && !m_ring.is_producer()) {
+        ++m_unclaimed_dropped;
+    }
+}
+
+//ShmLogStream
+ShmLogStream::ShmLogStream(const std::string &name):
+    LineStream<ShmLogStreamBuf>{name}
+{
+    check_open();
+}
+
+//ShmLogCollector
+ShmLogCollector::ShmLogCollector(const std::string &name, std::ostream &out,
+    const ShmRingOptions &options):
+    m_ring{name, ShmRingMode::CREATE, options},
+    m_out{out},
+    m_running{false}
+{
+}
+
+ShmLogCollector::~ShmLogCollector()
+{
+    stop();
+    m_ring.collect(m_out, true);
+    m_ring.unlink();
+}
+
+std::size_t ShmLogCollector::collect()
+{
+    std::lock_guard<std::mutex> lock{m_mut};
+    return m_ring.collect(m_out);
+}
+
+void ShmLogCollector::start(std::chrono::milliseconds interval)
+{
+    assert(!m_thread.joinable());
+    m_running = true;
+    m_thread = std::thread{[this, interval]() {
+        std::unique_lock<std::mutex> lock{m_mut};
+        while (m_running) {
+            if (m_ring.collect(m_out) == 0) {
+                m_cv.wait_for(lock, interval);
+            }
+        }
+    }};
+}
+
+void ShmLogCollector::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{m_mut};
+        m_running = false;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+} //namespace cc
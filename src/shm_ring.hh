@@ -0,0 +1,327 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#ifndef __CC_SHM_RING_H__
+#define __CC_SHM_RING_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "format.hh"
+
+namespace cc {
+
+/**
+ * @brief Enum class telling whether a \ref ShmLogRing creates the shared memory segment or
+ * attaches to an existing one
+ */
+enum class ShmRingMode {
+  CREATE, /**< Creates the segment, replacing any stale one with the same name */
+  ATTACH /**< Attaches to a segment created by another process or object */
+};
+
+/**
+ * @brief Geometry of a \ref ShmLogRing. Only used when the segment is created.
+ */
+struct ShmRingOptions {
+  /** Maximum number of producers attached at the same time */
+  std::size_t producers{32};
+  /** Number of records each producer can have pending */
+  std::size_t slots{256};
+  /** Maximum length of a record. Longer records are truncated, marked and counted */
+  std::size_t slot_size{512};
+  /** A producer which doesn't finish a record in this time stops holding back the output */
+  std::chrono::milliseconds stall_timeout{1000};
+};
+
+/**
+ * @brief Log ring in POSIX shared memory, written by several processes and read by a single
+ * collector.
+ *
+ * Each producer owns a region of the segment with its own ring of slots, so producers never
+ * contend with each other. Each record takes a number from a global sequence when it's started,
+ * and the collector writes the records in that order.
+ *
+ * Since a record is visible only once its producer commits it, the collector holds back records
+ * whose predecessors are still being written. Producers that die are detected by their process
+ * id. Their committed records are collected, the record they were writing is discarded, and
+ * their region is freed for a new producer.
+ *
+ * The producer functions of one object must not be called concurrently. The \ref Logger class
+ * serializes the writing of the log lines.
+ */
+class ShmLogRing final {
+public:
+  /**
+   * @brief Constructor of the class. It maps the shared memory segment.
+   * @param name The name of the segment, like `/my_app_log`
+   * @param mode Whether to create the segment or attach to an existing one
+   * @param options The geometry of the ring, used when the segment is created
+   */
+  ShmLogRing(const std::string &name, ShmRingMode mode,
+    const ShmRingOptions &options = ShmRingOptions{});
+  /**
+   * @brief Class destructor. Detaches the producer, if any, and unmaps the segment.
+   */
+  ~ShmLogRing();
+
+  /**
+   * @brief Deleted copy constructor
+   */
+  ShmLogRing(const ShmLogRing&) = delete;
+  /**
+   * @brief Deleted assignment operator
+   */
+  ShmLogRing& operator=(const ShmLogRing&) = delete;
+
+  /**
+   * @brief Whether the segment was mapped successfully.
+   */
+  bool is_open() const { return m_header != nullptr; }
+  /**
+   * @brief Removes the name of the segment. It's destroyed when the last process unmaps it.
+   */
+  void unlink();
+
+  /**
+   * @brief Claims a free producer region for the calling process.
+   *
+   * It's also called by \ref begin_record(std::size_t &capacity) when the process forked after
+   * the region was claimed, so the child gets its own region.
+   * @return False if all the regions are in use
+   */
+  bool attach_producer();
+  /**
+   * @brief Frees the producer region claimed by this object.
+   */
+  void detach_producer();
+  /**
+   * @brief Starts writing a record.
+   *
+   * It takes the sequence number of the record, and must be followed by
+   * \ref commit_record(std::size_t len).
+   * @param capacity Where the maximum length of the record is stored
+   * @return Where the record must be written, or nullptr if the ring of the producer is full
+   * and the record is dropped
+   */
+  char *begin_record(std::size_t &capacity);
+  /**
+   * @brief Publishes the record started with \ref begin_record(std::size_t &capacity).
+   * @param len The length of the record
+   */
+  void commit_record(std::size_t len);
+  /**
+   * @brief Writes a whole record.
+   *
+   * A record longer than the slot size is cut to fit, and ends with a marker like
+   * `... (1500 bytes)`, or `...` if the slot is too small for it.
+   * @param data The record
+   * @param len The length of the record
+   * @return False if there is no producer region or the ring is full and the record is dropped
+   */
+  bool write_record(const char *data, std::size_t len);
+  /**
+   * @brief Whether the calling process holds a producer region of this object.
+   */
+  bool is_producer() const;
+  /**
+   * @brief Number of records this producer dropped because its ring was full.
+   */
+  std::uint64_t dropped() const;
+  /**
+   * @brief Number of records this producer truncated because they didn't fit in a slot.
+   */
+  std::uint64_t truncated() const;
+
+  /**
+   * @brief Collects the committed records of all the producers and writes, one per line, those
+   * which can't be preceded by a record still being written.
+   * @param out Where the records are written
+   * @param flush_all Write all the collected records, even if some predecessor could still be
+   * committed. Used at shutdown
+   * @return The number of records written
+   */
+  std::size_t collect(std::ostream &out, bool flush_all = false);
+  /**
+   * @brief Number of records collected but held back to keep the order.
+   */
+  std::size_t held() const { return m_held.size(); }
+  /**
+   * @brief Number of producer regions currently claimed.
+   */
+  std::size_t active_producers() const;
+
+private:
+  struct Header;
+  struct Region;
+  struct Slot;
+  struct Record {
+    std::uint64_t seq;
+    std::string text;
+  };
+  struct StallState {
+    std::uint64_t low_seq;
+    std::chrono::steady_clock::time_point since;
+  };
+
+  bool create(const std::string &name, const ShmRingOptions &options);
+  bool attach(const std::string &name);
+  Region *region(std::size_t index) const;
+  Slot *slot(std::size_t region_index, std::uint64_t record) const;
+  void drain(std::size_t region_index);
+  void reclaim_dead_producers();
+
+  std::string m_name;
+  void *m_base;
+  std::size_t m_size;
+  Header *m_header;
+  std::size_t m_region;
+  int m_pid;
+  std::chrono::milliseconds m_stall_timeout;
+  std::vector<Record> m_held;
+  std::vector<StallState> m_stalls;
+};
+
+/**
+ * @brief std::streambuf writing each line to a \ref ShmLogRing as a record.
+ */
+class ShmLogStreamBuf final: public LineStreamBuf {
+public:
+  /**
+   * @brief Constructor of the class. It attaches to the segment and claims a producer region.
+   *
+   * If all the regions are in use, claiming one is retried on each line, and the lines written
+   * meanwhile are dropped.
+   * @param name The name of the segment, created by a \ref ShmLogCollector
+   */
+  explicit ShmLogStreamBuf(const std::string &name);
+
+  /**
+   * @brief Whether the segment was attached.
+   */
+  bool is_open() const { return m_ring.is_open(); }
+  /**
+   * @brief Number of records dropped because the collector lagged or there was no free
+   * producer region.
+   */
+  std::uint64_t dropped() const { return m_ring.dropped() + m_unclaimed_dropped; }
+  /**
+   * @brief Number of records truncated because they were longer than a slot.
+   */
+  std::uint64_t truncated() const { return m_ring.truncated(); }
+
+protected:
+  void complete_line(std::string &line) override;
+
+private:
+  ShmLogRing m_ring;
+  // Lines dropped without a producer region, which the ring doesn't count
+  std::uint64_t m_unclaimed_dropped;
+};
+
+/**
+ * @brief std::ostream writing to a shared memory log ring, so several processes can log into
+ * a single output written by a \ref ShmLogCollector.
+ *
+ * Each process, typically each pre-forked worker, uses its own producer region. A stream created
+ * before forking claims a new region in the child on its first line. Lines longer than
+ * ShmRingOptions::slot_size are truncated, see \ref ShmLogRing::write_record():
+ *
+ * `cc::ShmLogStream shm_log{"/my_app_log"};`
+ *
+ * If the segment can't be attached the failbit of the stream is set.
+ * @sa ShmLogStreamBuf
+ */
+class ShmLogStream final: public LineStream<ShmLogStreamBuf> {
+public:
+  /**
+   * @brief Constructor of the class.
+   * @param name The name of the segment, created by a \ref ShmLogCollector
+   */
+  explicit ShmLogStream(const std::string &name);
+
+  /**
+   * @brief Number of records dropped because the collector lagged or there was no free
+   * producer region.
+   */
+  std::uint64_t dropped() const { return m_buf.dropped(); }
+  /**
+   * @brief Number of records truncated because they were longer than a slot.
+   */
+  std::uint64_t truncated() const { return m_buf.truncated(); }
+};
+
+/**
+ * @brief Creates a shared memory log ring and writes the records of all its producers, in
+ * order, to a std::ostream.
+ *
+ * It can be driven by calling \ref collect(), or by a background thread with \ref start().
+ * On destruction the remaining records are written and the segment name is removed.
+ */
+class ShmLogCollector final {
+public:
+  /**
+   * @brief Constructor of the class. It creates the segment.
+   * @param name The name of the segment, like `/my_app_log`
+   * @param out Where the merged log is written
+   * @param options The geometry of the ring
+   */
+  ShmLogCollector(const std::string &name, std::ostream &out,
+    const ShmRingOptions &options = ShmRingOptions{});
+  /**
+   * @brief Class destructor. Stops the thread, writes the remaining records and removes the
+   * segment name.
+   */
+  ~ShmLogCollector();
+
+  /**
+   * @brief Deleted copy constructor
+   */
+  ShmLogCollector(const ShmLogCollector&) = delete;
+  /**
+   * @brief Deleted assignment operator
+   */
+  ShmLogCollector& operator=(const ShmLogCollector&) = delete;
+
+  /**
+   * @brief Whether the segment was created successfully.
+   */
+  bool is_open() const { return m_ring.is_open(); }
+  /**
+   * @brief Writes the records ready to be written.
+   * @return The number of records written
+   */
+  std::size_t collect();
+  /**
+   * @brief Starts a thread collecting records.
+   * @param interval Time the thread sleeps when there are no records
+   */
+  void start(std::chrono::milliseconds interval = std::chrono::milliseconds{10});
+  /**
+   * @brief Stops the collecting thread.
+   */
+  void stop();
+
+private:
+  ShmLogRing m_ring;
+  std::ostream &m_out;
+  std::mutex m_mut;
+  std::condition_variable m_cv;
+  bool m_running;
+  std::thread m_thread;
+};
+
+} //namespace cc
+
+#endif //__CC_SHM_RING_H__
@@ -0,0 +1,412 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "format.hh"
+#include "logger.hh"
+#include "socket_sink.hh"
+
+namespace cc {
+
+namespace {
+
+int connect_unix(const std::string &path, int type)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    if (path.size() >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    const int fd = ::socket(AF_UNIX, type | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connect_udp(const std::string &address)
+{
+    const std::string::size_type colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        return -1;
+    }
+    std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+    // Allow IPv6 literals written as [::1]:port
+    if ((host.size() >= 2) && (host.front() == '[') && (host.back() == ']')) {
+        host = host.substr(1, host.size() - 2);
+    }
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    addrinfo *result = nullptr;
+    if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0) {
+        return -1;
+    }
+
+    int fd = -1;
+    for (addrinfo *ai = result; ai != nullptr; ai = ai->ai_next) {
+        fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(result);
+    return fd;
+}
+
+// Connects the socket. It's switched to non-blocking afterwards, so sends never wait for the
+// collector
+int connect_socket(SocketKind kind, const std::string &address)
+{
+    int fd = -1;
+    switch (kind) {
+        case SocketKind::UDP:         fd = connect_udp(address); break;
+        case SocketKind::UNIX_DGRAM:  fd = connect_unix(address, SOCK_DGRAM); break;
+        case SocketKind::UNIX_STREAM: fd = connect_unix(address, SOCK_STREAM); break;
+    }
+    if (fd >= 0) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+// Syslog severity of ERROR. Records this severe or more are sent at once
+const int syslog_error = 3;
+
+// Syslog severity for the preamble written by Logger, and the length of the preamble
+int syslog_severity(const std::string &line, std::string::size_type &preamble_len)
+{
+    LogSeverity sev;
+    if (!parse_severity_tag(line.data(), line.size(), sev)) {
+        preamble_len = 0;
+        return 6;
+    }
+
+    preamble_len = severity_tag_length;
+    switch (sev) {
+        case LogSeverity::TRACE: return 7;
+        case LogSeverity::DEBUG: return 7;
+        case LogSeverity::INFO:  return 6;
+        case LogSeverity::WARN:  return 4;
+        case LogSeverity::ERROR: return 3;
+        case LogSeverity::FATAL: return 2;
+    default:
+        return 6;
+    }
+}
+
+bool is_transient(int err)
+{
+    return (err == EAGAIN) || (err == EWOULDBLOCK) || (err == ENOBUFS) || (err == EINTR);
+}
+
+// The collector went away, like when it's restarted. The socket must be connected again
+bool is_disconnection(int err)
+{
+    return (err == ECONNREFUSED) || (err == ENOTCONN) || (err == EPIPE) || (err == ECONNRESET);
+}
+
+} //namespace
+
+//SocketStreamBuf
+SocketStreamBuf::SocketStreamBuf(SocketKind kind, const std::string &address,
+    const SocketSinkOptions &options):
+    m_kind{kind},
+    m_address{address},
+    m_options{options},
+    m_hostname{"-"},
+    m_mut{},
+    m_fd{-1},
+    m_next_connect{},
+    m_reconnect_delay{options.reconnect_delay},
+    m_cv{},
+    m_stop{false},
+    m_pending{},
+    m_partial_offset{0},
+    m_oldest{},
+    m_sent{0},
+    m_dropped{0},
+    m_flusher{}
+{
+    // No other thread uses the object yet
+    connect_locked();
+
+    char hostname[256];
+    if ((m_options.framing == SocketFraming::RFC5424) &&
+        (::gethostname(hostname, sizeof(hostname)) == 0)) {
+        hostname[sizeof(hostname) - 1] = '\0';
+        m_hostname = hostname;
+    }
+
+    // With no delay every flush of a line sends it, so there are no deadlines to watch
+    if (m_options.max_delay > std::chrono::milliseconds::zero()) {
+        m_flusher = std::thread{&SocketStreamBuf::flush_on_deadline, this};
+    }
+}
+
+SocketStreamBuf::~SocketStreamBuf()
+{
+    if (m_flusher.joinable()) {
+        {
+            const std::lock_guard<std::mutex> lock(m_mut);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_flusher.join();
+    }
+
+    complete_last_line();
+    const std::lock_guard<std::mutex> lock(m_mut);
+    send_pending_locked();
+    m_dropped += m_pending.size();
+    disconnect_locked();
+}
+
+int SocketStreamBuf::sync()
+{
+    const std::lock_guard<std::mutex> lock(m_mut);
+    if (!m_pending.empty() &&
+        (std::chrono::steady_clock::now() - m_oldest >= m_options.max_delay)) {
+        send_pending_locked();
+    }
+    return 0;
+}
+
+bool SocketStreamBuf::is_open() const
+{
+    const std::lock_guard<std::mutex> lock(m_mut);
+    return m_fd >= 0;
+}
+
+std::size_t SocketStreamBuf::pending() const
+{
+    const std::lock_guard<std::mutex> lock(m_mut);
+    return m_pending.size();
+}
+
+void SocketStreamBuf::complete_line(std::string &line)
+{
+    std::string::size_type preamble_len = 0;
+    const int severity = syslog_severity(line, preamble_len);
+    std::string record;
+    if (m_options.framing == SocketFraming::RFC5424) {
+        frame_rfc5424(line, severity, preamble_len, record);
+    } else {
+        record.swap(line);
+        if (m_kind == SocketKind::UNIX_STREAM) {
+            record.push_back('\n');
+        }
+    }
+
+    const std::lock_guard<std::mutex> lock(m_mut);
+    if (m_pending.size() >= m_options.max_pending) {
+        ++m_dropped;
+        return;
+    }
+    if (m_pending.empty()) {
+        m_oldest = std::chrono::steady_clock::now();
+        m_cv.notify_one();
+    }
+    m_pending.push_back(std::move(record));
+
+    // An error may be the last thing the process logs, so it goes out now with the ones before it
+    if ((m_pending.size() >= m_options.batch_size) || (severity <= syslog_error)) {
+        send_pending_locked();
+    }
+}
+
+void SocketStreamBuf::frame_rfc5424(const std::string &line, int severity,
+    std::string::size_type preamble_len, std::string &record) const
+{
+    // <PRI>VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA MSG
+    std::string msg;
+    msg.reserve(line.size() + 96);
+    msg.push_back('<');
+    append_integer(msg, m_options.facility * 8 + severity);
+    msg.append(">1 ");
+    append_utc_timestamp(msg, utc_now_micros());
+    msg.push_back(' ');
+    msg.append(m_hostname);
+    msg.push_back(' ');
+    msg.append(m_options.app_name.empty() ? "-" : m_options.app_name);
+    msg.push_back(' ');
+    append_integer(msg, ::getpid());
+    msg.append(" - - ");
+    msg.append(line, preamble_len, std::string::npos);
+
+    if (m_kind == SocketKind::UNIX_STREAM) {
+        append_integer(record, msg.size());
+        record.push_back(' ');
+        record.append(msg);
+    } else {
+        record.swap(msg);
+    }
+}
+
+void SocketStreamBuf::send_pending()
+{
+    const std::lock_guard<std::mutex> lock(m_mut);
+    send_pending_locked();
+}
+
+void SocketStreamBuf::send_pending_locked()
+{
+    const std::size_t max_batch = 1024;
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    bool reconnected = false;
+
+    while (!m_pending.empty()) {
+        if ((m_fd < 0) && !connect_locked()) {
+            // The records wait for the collector, up to max_pending
+            return;
+        }
+
+        const std::size_t n = (m_pending.size() < max_batch) ? m_pending.size() : max_batch;
+        msgs.assign(n, mmsghdr{});
+        iovs.resize(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            const std::size_t offset = (i == 0) ? m_partial_offset : 0;
+            iovs[i].iov_base = const_cast<char *>(m_pending[i].data()) + offset;
+            iovs[i].iov_len = m_pending[i].size() - offset;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        const int r = ::sendmmsg(m_fd, msgs.data(), static_cast<unsigned>(n),
+            MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (r < 0) {
+            const int err = errno;
+            if (err == EINTR) {
+                continue;
+            }
+            if (is_transient(err)) {
+                // The collector lags. Keep the records and retry on the next batch or deadline
+                return;
+            }
+            if ((m_kind == SocketKind::UNIX_STREAM) || is_disconnection(err)) {
+                // The collector went away. The records are kept for the new connection, which
+                // is tried at once only the first time, so a collector refusing them isn't spun on
+                disconnect_locked();
+                if (reconnected) {
+                    back_off_locked();
+                    return;
+                }
+                reconnected = true;
+                continue;
+            }
+            // The datagram can't be sent (too big...). Drop only this one
+            m_pending.pop_front();
+            ++m_dropped;
+            continue;
+        }
+        if (r > 0) {
+            m_reconnect_delay = m_options.reconnect_delay;
+        }
+
+        for (int i = 0; i < r; ++i) {
+            if (msgs[i].msg_len < iovs[i].iov_len) {
+                // Only stream sockets write partially. The rest goes first in the next send
+                m_partial_offset += msgs[i].msg_len;
+                return;
+            }
+            m_pending.pop_front();
+            m_partial_offset = 0;
+            ++m_sent;
+        }
+    }
+
+    m_oldest = std::chrono::steady_clock::now();
+}
+
+bool SocketStreamBuf::connect_locked()
+{
+    if (m_fd >= 0) {
+        return true;
+    }
+    if (std::chrono::steady_clock::now() < m_next_connect) {
+        return false;
+    }
+    m_fd = connect_socket(m_kind, m_address);
+    if (m_fd < 0) {
+        back_off_locked();
+        return false;
+    }
+    return true;
+}
+
+void SocketStreamBuf::disconnect_locked()
+{
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    // A record partially written on a stream is sent again whole on the next connection
+    m_partial_offset = 0;
+}
+
+void SocketStreamBuf::back_off_locked()
+{
+    m_next_connect = std::chrono::steady_clock::now() + m_reconnect_delay;
+    m_reconnect_delay = std::min(m_reconnect_delay * 2, m_options.max_reconnect_delay);
+}
+
+void SocketStreamBuf::flush_on_deadline()
+{
+    std::unique_lock<std::mutex> lock(m_mut);
+    while (!m_stop) {
+        if (m_pending.empty()) {
+            m_cv.wait(lock);
+            continue;
+        }
+        const std::chrono::steady_clock::time_point deadline = m_oldest + m_options.max_delay;
+        if (std::chrono::steady_clock::now() < deadline) {
+            m_cv.wait_until(lock, deadline);
+            continue;
+        }
+        send_pending_locked();
+        // If the collector lags, the records left are retried when the delay elapses again
+        m_oldest = std::chrono::steady_clock::now();
+    }
+}
+
+//SocketStream
+SocketStream::SocketStream(SocketKind kind, const std::string &address,
+    const SocketSinkOptions &options):
+    LineStream<SocketStreamBuf>{kind, address, options}
+{
+    // Not connected yet is not a failure: the lines wait for the collector
+}
+
+} //namespace cc
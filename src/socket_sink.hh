@@ -0,0 +1,200 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#ifndef __CC_SOCKET_SINK_H__
+#define __CC_SOCKET_SINK_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "format.hh"
+
+namespace cc {
+
+/**
+ * @brief Enum class representing the kind of socket used to ship the log records
+ */
+enum class SocketKind {
+  UDP, /**< UDP datagrams. The address has the form "host:port" */
+  UNIX_DGRAM, /**< Unix-domain datagram socket. The address is the socket path */
+  UNIX_STREAM /**< Unix-domain stream socket. The address is the socket path */
+};
+
+/**
+ * @brief Enum class representing how each log record is framed on the socket
+ */
+enum class SocketFraming {
+  RAW, /**< The log line as is. On stream sockets each record ends with a new line */
+  RFC5424 /**< Syslog header (RFC 5424). On stream sockets octet counting (RFC 6587) is used */
+};
+
+/**
+ * @brief Options for the \ref SocketStream sink.
+ */
+struct SocketSinkOptions {
+  /** Records are sent when this number of records is pending */
+  std::size_t batch_size{64};
+  /**
+   * Longest time a record waits to be sent. A background thread sends the pending records when
+   * the oldest one reaches it. With zero, records are sent when each line is flushed
+   */
+  std::chrono::milliseconds max_delay{100};
+  /** Pending records kept while the collector lags or is away. Further records are dropped */
+  std::size_t max_pending{4096};
+  /** Wait before retrying a failed connection. It doubles on each failure */
+  std::chrono::milliseconds reconnect_delay{100};
+  /** Longest wait between connection attempts */
+  std::chrono::milliseconds max_reconnect_delay{5000};
+  /** Framing of the records */
+  SocketFraming framing{SocketFraming::RAW};
+  /** APP-NAME field of the RFC 5424 header */
+  std::string app_name{"cc_logger"};
+  /** Syslog facility of the RFC 5424 header. 1 means user-level messages */
+  int facility{1};
+};
+
+/**
+ * @brief std::streambuf splitting the characters written to it into log records, one per line,
+ * and sending them in batches through a non-blocking socket.
+ *
+ * Batches are sent with a single sendmmsg() call, when SocketSinkOptions::batch_size records are
+ * pending, when the oldest one has waited SocketSinkOptions::max_delay, or right away when a
+ * record of severity ERROR or FATAL is written, so it isn't lost if the process dies next.
+ * If the collector doesn't keep up or is not reachable, records stay pending up to
+ * SocketSinkOptions::max_pending, and newer records are dropped and counted. When the collector
+ * goes away, like when the local log agent restarts, the socket is connected again, waiting
+ * longer after each failed attempt, up to SocketSinkOptions::max_reconnect_delay.
+ * The writing of characters is not thread-safe, the \ref Logger class serializes it. The other
+ * member functions can be called from any thread.
+ */
+class SocketStreamBuf final: public LineStreamBuf {
+public:
+  /**
+   * @brief Constructor of the class. It connects the socket. If it can't, connecting is retried
+   * when records are sent.
+   * @param kind The kind of socket to use
+   * @param address The address of the collector. See \ref SocketKind
+   * @param options The sink options
+   */
+  SocketStreamBuf(SocketKind kind, const std::string &address, const SocketSinkOptions &options);
+  /**
+   * @brief Class destructor. Stops the background thread, tries to send the pending records and
+   * closes the socket.
+   */
+  ~SocketStreamBuf();
+
+  /**
+   * @brief Deleted copy constructor
+   */
+  SocketStreamBuf(const SocketStreamBuf&) = delete;
+  /**
+   * @brief Deleted assignment operator
+   */
+  SocketStreamBuf& operator=(const SocketStreamBuf&) = delete;
+
+  /**
+   * @brief Whether the socket is connected.
+   */
+  bool is_open() const;
+  /**
+   * @brief Sends all the pending records now, as far as the socket accepts them without blocking.
+   */
+  void send_pending();
+  /**
+   * @brief Number of records sent since construction.
+   */
+  std::uint64_t sent() const { return m_sent.load(); }
+  /**
+   * @brief Number of records dropped since construction.
+   */
+  std::uint64_t dropped() const { return m_dropped.load(); }
+  /**
+   * @brief Number of records waiting to be sent.
+   */
+  std::size_t pending() const;
+
+protected:
+  int sync() override;
+  void complete_line(std::string &line) override;
+
+private:
+  void frame_rfc5424(const std::string &line, int severity, std::string::size_type preamble_len,
+    std::string &record) const;
+  void send_pending_locked();
+  bool connect_locked();
+  void disconnect_locked();
+  void back_off_locked();
+  void flush_on_deadline();
+
+  const SocketKind m_kind;
+  const std::string m_address;
+  const SocketSinkOptions m_options;
+  std::string m_hostname;
+  // Guards the socket and the pending records, which the background thread sends too
+  mutable std::mutex m_mut;
+  int m_fd;
+  std::chrono::steady_clock::time_point m_next_connect;
+  std::chrono::milliseconds m_reconnect_delay;
+  std::condition_variable m_cv;
+  bool m_stop;
+  std::deque<std::string> m_pending;
+  std::size_t m_partial_offset;
+  std::chrono::steady_clock::time_point m_oldest;
+  std::atomic<std::uint64_t> m_sent;
+  std::atomic<std::uint64_t> m_dropped;
+  std::thread m_flusher;
+};
+
+/**
+ * @brief std::ostream shipping each log line to a local collector through a socket:
+ *
+ * `cc::SocketStream sink{cc::SocketKind::UDP, "127.0.0.1:5140"};`
+ *
+ * The stream stays usable while the collector is not reachable: the lines are kept pending, and
+ * dropped when there are too many, until the socket can be connected.
+ * @sa SocketStreamBuf
+ */
+class SocketStream final: public LineStream<SocketStreamBuf> {
+public:
+  /**
+   * @brief Constructor of the class.
+   * @param kind The kind of socket to use
+   * @param address The address of the collector. See \ref SocketKind
+   * @param options The sink options
+   */
+  SocketStream(SocketKind kind, const std::string &address,
+    const SocketSinkOptions &options = SocketSinkOptions{});
+
+  /**
+   * @brief Sends all the pending records now.
+   * @sa SocketStreamBuf::send_pending()
+   */
+  void send_pending() { m_buf.send_pending(); }
+  /**
+   * @brief Number of records sent since construction.
+   */
+  std::uint64_t sent() const { return m_buf.sent(); }
+  /**
+   * @brief Number of records dropped because the collector lagged or was not reachable.
+   */
+  std::uint64_t dropped() const { return m_buf.dropped(); }
+  /**
+   * @brief Number of records waiting to be sent.
+   */
+  std::size_t pending() const { return m_buf.pending(); }
+};
+
+} //namespace cc
+
+#endif //__CC_SOCKET_SINK_H__
@@ -0,0 +1,168 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "encode.hh"
+#include "logger.hh"
+
+using namespace testing;
+using namespace cc;
+using namespace std;
+
+namespace {
+
+string reference_hex(const vector<unsigned char> &data)
+{
+  ostringstream oss;
+  for (auto byte: data) {
+    oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(byte);
+  }
+  return oss.str();
+}
+
+string reference_base64(const vector<unsigned char> &data)
+{
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  string out;
+  size_t i = 0;
+  for (; i + 2 < data.size(); i += 3) {
+    out += alphabet[data[i] >> 2];
+    out += alphabet[((data[i] & 3) << 4) | (data[i + 1] >> 4)];
+    out += alphabet[((data[i + 1] & 15) << 2) | (data[i + 2] >> 6)];
+    out += alphabet[data[i + 2] & 63];
+  }
+  if (data.size() - i == 1) {
+    out += alphabet[data[i] >> 2];
+    out += alphabet[(data[i] & 3) << 4];
+    out += "==";
+  } else if (data.size() - i == 2) {
+    out += alphabet[data[i] >> 2];
+    out += alphabet[((data[i] & 3) << 4) | (data[i + 1] >> 4)];
+    out += alphabet[(data[i + 1] & 15) << 2];
+    out += "=";
+  }
+  return out;
+}
+
+} //namespace
+
+TEST(Encode, Base64Rfc4648Vectors)
+{
+  const char *inputs[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+  const char *outputs[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+
+  for (size_t i = 0; i < 7; ++i) {
+    string encoded;
+    append_encoded(encoded, base64(inputs[i], string(inputs[i]).size()));
+    ASSERT_EQ(encoded, outputs[i]);
+  }
+}
+
+TEST(Encode, HexAndBase64AllLengths)
+{
+  ASSERT_NE(hex_encoder(EncodeLevel::SCALAR), nullptr);
+  ASSERT_NE(base64_encoder(EncodeLevel::SCALAR), nullptr);
+
+  // Every kernel the CPU supports, not only the one hex_encode and base64_encode picked
+  const EncodeLevel levels[] = {EncodeLevel::SCALAR, EncodeLevel::SSE, EncodeLevel::AVX2};
+  for (EncodeLevel level: levels) {
+    const EncodeFunction hex_kernel = hex_encoder(level);
+    const EncodeFunction base64_kernel = base64_encoder(level);
+    const int level_id = static_cast<int>(level);
+
+    mt19937 gen{7};
+    // Covers the SIMD loops, their tails, and every byte value
+    for (size_t len = 0; len < 300; ++len) {
+      vector<unsigned char> data(len);
+      for (auto &byte: data) {
+        byte = static_cast<unsigned char>(gen());
+      }
+
+      if (hex_kernel != nullptr) {
+        string hex(2 * len, '?');
+        hex_kernel(data.data(), len, &hex[0]);
+        ASSERT_EQ(hex, reference_hex(data)) << "level " << level_id << " len " << len;
+      }
+      if (base64_kernel != nullptr) {
+        string b64(base64_encoded_length(len), '?');
+        base64_kernel(data.data(), len, &b64[0]);
+        ASSERT_EQ(b64, reference_base64(data)) << "level " << level_id << " len " << len;
+      }
+    }
+
+    if (hex_kernel != nullptr) {
+      vector<unsigned char> all(256);
+      for (size_t i = 0; i < all.size(); ++i) {
+        all[i] = static_cast<unsigned char>(i);
+      }
+      string hex(512, '?');
+      hex_kernel(all.data(), all.size(), &hex[0]);
+      ASSERT_EQ(hex, reference_hex(all)) << "level " << level_id;
+    }
+  }
+
+  // And the dispatching entry points
+  const vector<unsigned char> data{0x00, 0x7f, 0x80, 0xff, 0x10};
+  string hex(2 * data.size(), '?');
+  hex_encode(data.data(), data.size(), &hex[0]);
+  ASSERT_EQ(hex, reference_hex(data));
+  string b64(base64_encoded_length(data.size()), '?');
+  base64_encode(data.data(), data.size(), &b64[0]);
+  ASSERT_EQ(b64, reference_base64(data));
+}
+
+TEST(Encode, Truncation)
+{
+  const unsigned char data[] = {0xde, 0xad, 0xbe, 0xef, 0x00, 0x01};
+
+  string s;
+  append_encoded(s, hexdump(data, sizeof(data), 4));
+  ASSERT_EQ(s, "deadbeef... (6 bytes)");
+
+  s.clear();
+  append_encoded(s, hexdump(data, sizeof(data), 6));
+  ASSERT_EQ(s, "deadbeef0001");
+
+  s.clear();
+  append_encoded(s, base64(data, sizeof(data), 3));
+  ASSERT_EQ(s, "3q2+... (6 bytes)");
+}
+
+TEST(Encode, Logging)
+{
+  stringstream ss;
+  Logger logger{ss, LogSeverity::DEBUG};
+  const unsigned char packet[] = {0x01, 0x02, 0xab, 0xff};
+
+  logger.log(LogSeverity::DEBUG) << "packet " << hexdump(packet, sizeof(packet)) << " b64 "
+    << base64(packet, sizeof(packet)) << " len " << sizeof(packet);
+  logger.log(LogSeverity::TRACE) << "filtered " << hexdump(packet, sizeof(packet));
+
+  ASSERT_EQ(ss.str(), "[DEBUG] packet 0102abff b64 AQKr/w== len 4\n");
+}
+
+TEST(Encode, OstreamAndWidth)
+{
+  const unsigned char packet[] = {0x0a, 0x0b};
+
+  ostringstream oss;
+  oss << hexdump(packet, sizeof(packet)) << "|" << std::setw(6) << hexdump(packet, sizeof(packet));
+  ASSERT_EQ(oss.str(), "0a0b|  0a0b");
+
+  stringstream ss;
+  Logger logger{ss, LogSeverity::DEBUG};
+  logger.log(LogSeverity::INFO) << std::setw(6) << hexdump(packet, sizeof(packet)) << "|"
+    << std::left << std::setw(6) << base64(packet, sizeof(packet)) << "|";
+  ASSERT_EQ(ss.str(), "[INFO ]   0a0b|Cgs=  |\n");
+}
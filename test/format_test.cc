@@ -0,0 +1,272 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <locale>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "format.hh"
+#include "logger.hh"
+#include "user_data_test.hh"
+
+using namespace testing;
+using namespace cc;
+using namespace std;
+
+// Checks that a chain of insertions produces through the Logger the same text std::ostream does
+#define ASSERT_SAME_AS_OSTREAM(chain) \
+  { \
+    stringstream out; \
+    Logger logger{out, LogSeverity::DEBUG}; \
+    logger.log(LogSeverity::INFO) chain; \
+    ostringstream ref; \
+    ref chain; \
+    ASSERT_EQ(out.str(), "[INFO ] " + ref.str() + "\n"); \
+  }
+
+TEST(Format, AppendDecimal)
+{
+  string s;
+  append_integer(s, 0);
+  ASSERT_EQ(s, "0");
+
+  s.clear();
+  append_integer(s, -7);
+  ASSERT_EQ(s, "-7");
+
+  s.clear();
+  append_integer(s, 1234567890);
+  ASSERT_EQ(s, "1234567890");
+
+  s.clear();
+  append_integer(s, LLONG_MIN);
+  ASSERT_EQ(s, to_string(LLONG_MIN));
+
+  s.clear();
+  append_integer(s, ULLONG_MAX);
+  ASSERT_EQ(s, to_string(ULLONG_MAX));
+
+  for (long long v = -1000; v <= 1000; ++v) {
+    s.clear();
+    append_integer(s, v);
+    ASSERT_EQ(s, to_string(v));
+  }
+}
+
+TEST(Format, Integers)
+{
+  short s_short{-32768};
+  unsigned short s_ushort{65535};
+  int n_int{INT_MIN};
+  unsigned n_uint{UINT_MAX};
+  long n_long{LONG_MIN};
+  unsigned long n_ulong{ULONG_MAX};
+  long long n_llong{LLONG_MAX};
+
+  ASSERT_SAME_AS_OSTREAM(<< s_short << " " << s_ushort << " " << n_int << " " << n_uint);
+  ASSERT_SAME_AS_OSTREAM(<< n_long << " " << n_ulong << " " << n_llong << " " << 0 << 9 << 10);
+}
+
+TEST(Format, CharactersAndBooleans)
+{
+  char c{'a'};
+  signed char sc{'b'};
+  unsigned char uc{'c'};
+
+  ASSERT_SAME_AS_OSTREAM(<< c << sc << uc << true << false);
+  ASSERT_SAME_AS_OSTREAM(<< std::boolalpha << true << " " << false);
+}
+
+TEST(Format, IntegerManipulators)
+{
+  ASSERT_SAME_AS_OSTREAM(<< std::hex << 100 << " " << 255 << std::dec << " " << 255);
+  ASSERT_SAME_AS_OSTREAM(<< "#" << std::setw(10) << 200 << "#" << 300);
+  ASSERT_SAME_AS_OSTREAM(<< std::setfill('0') << std::setw(8) << -42 << std::left << std::setw(5) << 7 << "|");
+  ASSERT_SAME_AS_OSTREAM(<< std::showpos << 5 << " " << -5 << " " << 5u);
+  ASSERT_SAME_AS_OSTREAM(<< std::oct << std::showbase << 8 << std::uppercase << std::hex << 255);
+}
+
+TEST(Format, FloatingPoint)
+{
+  float n_float{345.837465834f};
+  double n_double{29287449.197389950734954837};
+  long double n_ldouble{1.0L / 3.0L};
+
+  ASSERT_SAME_AS_OSTREAM(<< n_float << " " << n_double << " " << n_ldouble);
+  ASSERT_SAME_AS_OSTREAM(<< 0.0 << " " << -0.0 << " " << 1e-300 << " " << 1e300 << " " << 100.0);
+  ASSERT_SAME_AS_OSTREAM(<< numeric_limits<double>::infinity() << " " << -numeric_limits<double>::infinity());
+  ASSERT_SAME_AS_OSTREAM(<< numeric_limits<double>::quiet_NaN() << " " << numeric_limits<double>::max());
+  ASSERT_SAME_AS_OSTREAM(<< numeric_limits<double>::min() << " " << numeric_limits<double>::denorm_min());
+}
+
+TEST(Format, FloatingPointManipulators)
+{
+  double n_double{29287449.197389950734954837};
+
+  ASSERT_SAME_AS_OSTREAM(<< std::fixed << std::setprecision(8) << n_double);
+  ASSERT_SAME_AS_OSTREAM(<< std::fixed << 1e300 << " " << std::setprecision(0) << 2.5);
+  ASSERT_SAME_AS_OSTREAM(<< std::scientific << n_double << " " << std::uppercase << n_double);
+  ASSERT_SAME_AS_OSTREAM(<< std::uppercase << 1e-20 << " " << numeric_limits<double>::infinity());
+  ASSERT_SAME_AS_OSTREAM(<< std::showpos << std::showpoint << 3.0 << " " << -3.0);
+  ASSERT_SAME_AS_OSTREAM(<< std::setprecision(17) << 0.1 << " " << std::setprecision(-1) << 0.1);
+  ASSERT_SAME_AS_OSTREAM(<< std::hexfloat << n_double << std::defaultfloat << " " << n_double);
+  ASSERT_SAME_AS_OSTREAM(<< std::setw(12) << 1.5 << "|" << std::left << std::setw(12) << 1.5 << "|");
+}
+
+TEST(Format, FloatingPointMatchesOstream)
+{
+  mt19937_64 gen{5};
+  const ios_base::fmtflags fields[] = {ios_base::fmtflags{}, ios_base::fixed, ios_base::scientific};
+  // Exact ties, values rounding into a new digit, %#g switching to scientific on that carry
+  const double special[] = {0.5, 1.5, 2.5, 0.125, 0.375, 99.96, 999.6, 9.9996, 9.96e5,
+    0.0009996, 1e22, 1e23, 5e-324, 1.7976931348623157e308};
+
+  for (int i = 0; i < 20000; ++i) {
+    double value;
+    if (i < 14 * 16) {
+      value = special[i / 16];
+    } else {
+      const uint64_t bits = gen();
+      memcpy(&value, &bits, sizeof(value));
+    }
+    ios_base::fmtflags flags = fields[gen() % 3];
+    if (gen() % 4 == 0) {
+      flags |= ios_base::showpoint;
+    }
+    if (gen() % 4 == 0) {
+      flags |= ios_base::showpos | ios_base::uppercase;
+    }
+    const streamsize precision = static_cast<streamsize>(gen() % 25);
+
+    ostringstream oss;
+    oss.flags(flags);
+    oss.precision(precision);
+    string result;
+    if (i % 4 == 0) {
+      const long double ld_value = static_cast<long double>(value) / 3;
+      oss << ld_value;
+      append_floating(result, ld_value, flags, precision);
+    } else {
+      oss << value;
+      append_floating(result, value, flags, precision);
+    }
+    ASSERT_EQ(result, oss.str()) << "flags " << flags << " precision " << precision;
+  }
+}
+
+TEST(Format, Strings)
+{
+  string s_string{"STRING EXAMPLE"};
+  char c_array[] = "CHAR ARRAY";
+  char *c_ptr = c_array;
+
+  ASSERT_SAME_AS_OSTREAM(<< "Literal " << s_string << " " << c_array << " " << c_ptr);
+  ASSERT_SAME_AS_OSTREAM(<< std::setw(20) << s_string << "|" << std::setw(3) << "abcdef" << "|");
+  ASSERT_SAME_AS_OSTREAM(<< std::right << std::setfill('*') << std::setw(8) << "ab" << string("cd"));
+}
+
+TEST(Format, MixedWithUserDataTypes)
+{
+  UserDataTest user_data_test{UserFieldTest{100, "UserFieldTest"}, "UserDataTest"};
+
+  ASSERT_SAME_AS_OSTREAM(<< 1 << user_data_test << 2.5 << std::hex << 255 << user_data_test << 3);
+}
+
+namespace {
+
+struct GroupingNumpunct: numpunct<char> {
+  char do_thousands_sep() const override { return ','; }
+  string do_grouping() const override { return "\3"; }
+};
+
+} //namespace
+
+TEST(Format, LocaleChangedAfterConstruction)
+{
+  stringstream out;
+  Logger logger{out, LogSeverity::DEBUG};
+
+  const locale previous = locale::global(locale{locale::classic(), new GroupingNumpunct});
+  logger.log(LogSeverity::INFO) << 1000000 << " " << std::setw(10) << 1000000 << " " << 0.5;
+  locale::global(previous);
+
+  // Both the fast path and the std::ostream keep the locale seen at construction
+  ASSERT_EQ(out.str(), "[INFO ] 1000000    1000000 0.5\n");
+}
+
+TEST(Format, OstreamManipulators)
+{
+  stringstream out;
+  Logger logger{out, LogSeverity::DEBUG};
+
+  logger.log(LogSeverity::INFO) << "first" << std::endl << "second" << std::flush << 1;
+
+  ASSERT_EQ(out.str(), "[INFO ] first\nsecond1\n");
+}
+
+TEST(Format, FilteredOut)
+{
+  stringstream out;
+  Logger logger{out, LogSeverity::ERROR};
+
+  logger.log(LogSeverity::INFO) << "Text " << 1 << 2.0 << std::hex << 3 << std::endl;
+
+  ASSERT_EQ(out.str(), "");
+}
+
+TEST(Format, UtcTimestamp)
+{
+  string s;
+  append_utc_timestamp(s, 0);
+  ASSERT_EQ(s, "1970-01-01T00:00:00.000000Z");
+
+  s.clear();
+  append_utc_timestamp(s, 1682948707123456LL);
+  ASSERT_EQ(s, "2023-05-01T13:45:07.123456Z");
+  ASSERT_EQ(s.size(), utc_timestamp_length);
+
+  s.clear();
+  append_utc_timestamp(s, -500000);
+  ASSERT_EQ(s, "1969-12-31T23:59:59.500000Z");
+
+  s.clear();
+  append_utc_timestamp(s, 1709164800000000LL);
+  ASSERT_EQ(s, "2024-02-29T00:00:00.000000Z");
+}
+
+TEST(Format, ParseUtcTimestamp)
+{
+  int64_t micros = 0;
+
+  ASSERT_EQ(parse_utc_timestamp("2023-05-01T13:45:07.123456Z [INFO ]", 35, micros), 27u);
+  ASSERT_EQ(micros, 1682948707123456LL);
+
+  ASSERT_EQ(parse_utc_timestamp("2023-05-01 13:45:07", 19, micros), 19u);
+  ASSERT_EQ(micros, 1682948707000000LL);
+
+  ASSERT_EQ(parse_utc_timestamp("2023-05-01T13:45:07.5", 21, micros), 21u);
+  ASSERT_EQ(micros, 1682948707500000LL);
+
+  ASSERT_EQ(parse_utc_timestamp("[INFO ] 2023-05-01T13:45:07", 27, micros), 0u);
+  ASSERT_EQ(parse_utc_timestamp("2023-13-01T13:45:07", 19, micros), 0u);
+  ASSERT_EQ(parse_utc_timestamp("2023-05-01T13:45", 16, micros), 0u);
+
+  for (int64_t t = -86400000000LL; t < 4102444800000000LL; t += 987654321987LL) {
+    string s;
+    append_utc_timestamp(s, t);
+    ASSERT_EQ(parse_utc_timestamp(s.data(), s.size(), micros), utc_timestamp_length);
+    ASSERT_EQ(micros, t);
+  }
+}
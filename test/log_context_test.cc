@@ -0,0 +1,116 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "log_context.hh"
+#include "logger.hh"
+#include "user_data_test.hh"
+
+using namespace testing;
+using namespace cc;
+using namespace std;
+
+TEST(LogContext, ScopedKeyValues)
+{
+  stringstream ss;
+  Logger logger{ss, LogSeverity::DEBUG};
+
+  logger.log(LogSeverity::INFO) << "outside";
+  {
+    ScopedLogContext req{"req", 42};
+    logger.log(LogSeverity::INFO) << "request";
+    {
+      ScopedLogContext user{"user", "bob"};
+      logger.log(LogSeverity::WARN) << "nested";
+    }
+    logger.log(LogSeverity::ERROR) << "popped";
+  }
+  logger.log(LogSeverity::INFO) << "outside again";
+
+  ASSERT_EQ(ss.str(),
+    "[INFO ] outside\n"
+    "[INFO ] [req=42] request\n"
+    "[WARN ] [req=42] [user=bob] nested\n"
+    "[ERROR] [req=42] popped\n"
+    "[INFO ] outside again\n");
+}
+
+TEST(LogContext, ValueTypes)
+{
+  stringstream ss;
+  Logger logger{ss, LogSeverity::DEBUG};
+  {
+    ScopedLogContext a{"id", -7LL};
+    ScopedLogContext b{"name", string{"x"}};
+    ScopedLogContext c{"ratio", 0.5};
+    ScopedLogContext d{"user", UserDataTest{}};
+    ostringstream expected;
+    expected << "[INFO ] [id=-7] [name=x] [ratio=0.5] [user=" << UserDataTest{} << "] line\n";
+    logger.log(LogSeverity::INFO) << "line";
+    ASSERT_EQ(ss.str(), expected.str());
+  }
+}
+
+TEST(LogContext, ThreadName)
+{
+  stringstream ss;
+  Logger logger{ss, LogSeverity::DEBUG};
+
+  thread t{[&logger]() {
+    set_log_thread_name("worker-1");
+    ScopedLogContext req{"req", 5};
+    logger.log(LogSeverity::INFO) << "in thread";
+    logger.log(LogSeverity::TRACE) << "filtered";
+  }};
+  t.join();
+  logger.log(LogSeverity::INFO) << "main";
+
+  ASSERT_EQ(ss.str(), "[INFO ] [worker-1] [req=5] in thread\n[INFO ] main\n");
+  ASSERT_EQ(log_thread_name(), "");
+
+  set_log_thread_name("main");
+  ASSERT_EQ(log_thread_name(), "main");
+  set_log_thread_name("");
+  ASSERT_EQ(log_thread_name(), "");
+}
+
+TEST(LogContext, AsyncHandOff)
+{
+  stringstream ss;
+  Logger logger{ss, LogSeverity::DEBUG};
+
+  LogContext captured;
+  ASSERT_TRUE(captured.empty());
+  {
+    ScopedLogContext req{"req", 99};
+    captured = capture_log_context();
+  }
+  // The capture outlives the scope
+  ASSERT_EQ(captured.text(), "[req=99] ");
+  ASSERT_TRUE(capture_log_context().empty());
+
+  thread t{[&logger, captured]() {
+    set_log_thread_name("writer");
+    ScopedLogContext job{"job", "flush"};
+    {
+      AdoptedLogContext adopted{captured};
+      ScopedLogContext step{"step", 1};
+      logger.log(LogSeverity::INFO) << "adopted";
+    }
+    logger.log(LogSeverity::INFO) << "restored";
+  }};
+  t.join();
+
+  ASSERT_EQ(ss.str(),
+    "[INFO ] [writer] [req=99] [step=1] adopted\n"
+    "[INFO ] [writer] [job=flush] restored\n");
+}
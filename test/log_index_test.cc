@@ -0,0 +1,185 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "format.hh"
+#include "log_index.hh"
+#include "logger.hh"
+
+using namespace testing;
+using namespace cc;
+using namespace std;
+
+namespace {
+
+string read_file(const string &path)
+{
+  ifstream ifs(path, ios_base::binary);
+  return string((istreambuf_iterator<char>(ifs)), (istreambuf_iterator<char>()));
+}
+
+void remove_log(const string &path)
+{
+  remove(path.c_str());
+  remove((path + log_index_suffix).c_str());
+}
+
+} //namespace
+
+TEST(LogIndex, LinesAreTimestamped)
+{
+  const string path{"indexed_timestamps.log"};
+  remove_log(path);
+  {
+    IndexedLogFile log_file{path};
+    ASSERT_TRUE(log_file.is_open());
+    Logger logger{log_file, LogSeverity::DEBUG};
+
+    logger.log(LogSeverity::INFO) << "Indexed " << 1;
+  }
+
+  const string content = read_file(path);
+  int64_t micros = 0;
+  ASSERT_EQ(parse_utc_timestamp(content.data(), content.size(), micros), utc_timestamp_length);
+  ASSERT_EQ(content.substr(utc_timestamp_length), " [INFO ] Indexed 1\n");
+}
+
+TEST(LogIndex, Blocks)
+{
+  const string path{"indexed_blocks.log"};
+  remove_log(path);
+  {
+    IndexedLogFile log_file{path, false, 256};
+    Logger logger{log_file, LogSeverity::TRACE};
+
+    for (int i = 0; i < 100; ++i) {
+      logger.log(static_cast<LogSeverity>(i % 6)) << "Line number " << i;
+    }
+  }
+
+  vector<LogIndexBlock> blocks;
+  ASSERT_TRUE(read_log_index(path + log_index_suffix, blocks));
+  ASSERT_GT(blocks.size(), 1u);
+
+  const string content = read_file(path);
+  uint64_t offset = 0;
+  uint32_t lines = 0;
+  uint32_t severity_counts[log_severity_count] = {};
+  for (const auto &block: blocks) {
+    ASSERT_FALSE(block.unknown);
+    ASSERT_EQ(block.offset, offset);
+    ASSERT_LE(block.min_micros, block.max_micros);
+    // Blocks end at line boundaries
+    ASSERT_EQ(content[block.offset + block.length - 1], '\n');
+    offset += block.length;
+    lines += block.lines;
+    for (size_t s = 0; s < log_severity_count; ++s) {
+      severity_counts[s] += block.severity_counts[s];
+    }
+  }
+  ASSERT_EQ(offset, content.size());
+  ASSERT_EQ(lines, 100u);
+  ASSERT_THAT(severity_counts, ElementsAre(17u, 17u, 17u, 17u, 16u, 16u));
+}
+
+TEST(LogIndex, Append)
+{
+  const string path{"indexed_append.log"};
+  remove_log(path);
+  for (int run = 0; run < 2; ++run) {
+    IndexedLogFile log_file{path, true, 128};
+    Logger logger{log_file, LogSeverity::DEBUG};
+    for (int i = 0; i < 20; ++i) {
+      logger.log(LogSeverity::WARN) << "Run " << run << " line " << i;
+    }
+  }
+
+  vector<LogIndexBlock> blocks;
+  ASSERT_TRUE(read_log_index(path + log_index_suffix, blocks));
+
+  uint64_t offset = 0;
+  uint32_t warnings = 0;
+  for (const auto &block: blocks) {
+    ASSERT_FALSE(block.unknown);
+    ASSERT_EQ(block.offset, offset);
+    offset += block.length;
+    warnings += block.severity_counts[static_cast<size_t>(LogSeverity::WARN)];
+  }
+  ASSERT_EQ(offset, read_file(path).size());
+  ASSERT_EQ(warnings, 40u);
+}
+
+TEST(LogIndex, AppendToFileWithoutIndex)
+{
+  const string path{"indexed_unknown.log"};
+  remove_log(path);
+  {
+    ofstream ofs{path};
+    ofs << "[INFO ] Written without index\n";
+  }
+  {
+    IndexedLogFile log_file{path, true};
+    Logger logger{log_file, LogSeverity::DEBUG};
+    logger.log(LogSeverity::INFO) << "Written with index";
+  }
+
+  vector<LogIndexBlock> blocks;
+  ASSERT_TRUE(read_log_index(path + log_index_suffix, blocks));
+  ASSERT_EQ(blocks.size(), 2u);
+  ASSERT_TRUE(blocks[0].unknown);
+  ASSERT_EQ(blocks[0].offset, 0u);
+  ASSERT_EQ(blocks[0].length, string("[INFO ] Written without index\n").size());
+  ASSERT_FALSE(blocks[1].unknown);
+  ASSERT_EQ(blocks[1].offset, blocks[0].length);
+  ASSERT_EQ(blocks[1].lines, 1u);
+
+  // The last line was cut by a crash. The new lines start on their own line
+  {
+    ofstream ofs{path, ios_base::app};
+    ofs << "[ERROR] crashed mid-li";
+  }
+  {
+    IndexedLogFile log_file{path, true};
+    Logger logger{log_file, LogSeverity::DEBUG};
+    logger.log(LogSeverity::INFO) << "After restart";
+  }
+
+  ifstream ifs{path};
+  vector<string> lines;
+  for (string line; getline(ifs, line);) {
+    lines.push_back(line);
+  }
+  ASSERT_EQ(lines.size(), 4u);
+  ASSERT_EQ(lines[2], "[ERROR] crashed mid-li");
+  ASSERT_THAT(lines[3], EndsWith(" [INFO ] After restart"));
+
+  blocks.clear();
+  ASSERT_TRUE(read_log_index(path + log_index_suffix, blocks));
+  ASSERT_EQ(blocks.size(), 4u);
+  ASSERT_TRUE(blocks[2].unknown);
+  ASSERT_EQ(blocks[2].length, string("[ERROR] crashed mid-li\n").size());
+  ASSERT_EQ(blocks[3].offset, blocks[2].offset + blocks[2].length);
+  ASSERT_EQ(blocks[3].lines, 1u);
+}
+
+TEST(LogIndex, NotAnIndex)
+{
+  vector<LogIndexBlock> blocks;
+  ASSERT_FALSE(read_log_index("missing_file.log.idx", blocks));
+
+  {
+    ofstream ofs{"not_an_index.idx"};
+    ofs << "This is not an index file";
+  }
+  ASSERT_FALSE(read_log_index("not_an_index.idx", blocks));
+}
@@ -0,0 +1,207 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "format.hh"
+#include "log_index.hh"
+#include "log_query.hh"
+#include "logger.hh"
+
+using namespace testing;
+using namespace cc;
+using namespace std;
+
+namespace {
+
+void remove_log(const string &path)
+{
+  remove(path.c_str());
+  remove((path + log_index_suffix).c_str());
+}
+
+// Writes 600 lines, 100 per severity, in small blocks
+void write_log(const string &path)
+{
+  remove_log(path);
+  IndexedLogFile log_file{path, false, 512};
+  Logger logger{log_file, LogSeverity::TRACE};
+  for (int i = 0; i < 600; ++i) {
+    logger.log(i < 500 ? static_cast<LogSeverity>(i % 5) : LogSeverity::FATAL)
+      << "request " << i << (i % 10 == 0 ? " timeout" : " ok");
+  }
+}
+
+} //namespace
+
+TEST(LogQuery, FindSubstring)
+{
+  mt19937 gen{42};
+  uniform_int_distribution<int> letter{'a', 'c'};
+
+  for (int round = 0; round < 2000; ++round) {
+    string haystack(gen() % 100, ' ');
+    for (auto &c: haystack) {
+      c = static_cast<char>(letter(gen));
+    }
+    string needle(1 + gen() % 5, ' ');
+    for (auto &c: needle) {
+      c = static_cast<char>(letter(gen));
+    }
+
+    const char *found = find_substring(haystack.data(), haystack.size(), needle.data(), needle.size());
+    const string::size_type expected = haystack.find(needle);
+    if (expected == string::npos) {
+      ASSERT_EQ(found, nullptr) << haystack << " / " << needle;
+    } else {
+      ASSERT_EQ(found, haystack.data() + expected) << haystack << " / " << needle;
+    }
+  }
+
+  const char abc[] = "abc";
+  ASSERT_EQ(find_substring(abc, 3, "", 0), abc);
+  ASSERT_EQ(find_substring(abc, 2, "abc", 3), nullptr);
+}
+
+TEST(LogQuery, Pattern)
+{
+  const string path{"query_pattern.log"};
+  write_log(path);
+
+  LogQuery query;
+  query.pattern = "timeout";
+  stringstream out;
+  LogQueryStats stats;
+  ASSERT_TRUE(query_log(path, query, out, stats));
+
+  ASSERT_EQ(stats.matches, 60u);
+  ASSERT_EQ(stats.skipped_blocks, 0u);
+  ASSERT_GT(stats.blocks, 1u);
+
+  string line;
+  int n = 0;
+  while (getline(out, line)) {
+    ASSERT_THAT(line, EndsWith("request " + to_string(n * 10) + " timeout"));
+    ++n;
+  }
+  ASSERT_EQ(n, 60);
+}
+
+TEST(LogQuery, Severity)
+{
+  const string path{"query_severity.log"};
+  write_log(path);
+
+  LogQuery query;
+  query.min_severity = LogSeverity::FATAL;
+  query.count_only = true;
+  stringstream out;
+  LogQueryStats stats;
+  ASSERT_TRUE(query_log(path, query, out, stats));
+
+  ASSERT_EQ(stats.matches, 100u);
+  ASSERT_EQ(out.str(), "");
+  // The blocks with only lower severities are not read
+  ASSERT_GT(stats.skipped_blocks, 0u);
+
+  query.min_severity = LogSeverity::ERROR;
+  query.pattern = "timeout";
+  query.count_only = false;
+  ASSERT_TRUE(query_log(path, query, out, stats));
+  // Timeouts below ERROR are filtered out line by line
+  ASSERT_EQ(stats.matches, 10u);
+  ASSERT_THAT(out.str(), HasSubstr("[FATAL] request 590 timeout\n"));
+  ASSERT_THAT(out.str(), Not(HasSubstr("request 0 timeout")));
+}
+
+TEST(LogQuery, TimeRange)
+{
+  const string path{"query_time.log"};
+  remove_log(path);
+  int64_t middle = 0;
+  {
+    IndexedLogFile log_file{path, false, 256};
+    Logger logger{log_file, LogSeverity::TRACE};
+    for (int i = 0; i < 50; ++i) {
+      logger.log(LogSeverity::INFO) << "before " << i;
+    }
+    this_thread::sleep_for(chrono::milliseconds(20));
+    middle = utc_now_micros();
+    this_thread::sleep_for(chrono::milliseconds(20));
+    for (int i = 0; i < 50; ++i) {
+      logger.log(LogSeverity::INFO) << "after " << i;
+    }
+  }
+
+  LogQuery query;
+  query.from_micros = middle;
+  stringstream out;
+  LogQueryStats stats;
+  ASSERT_TRUE(query_log(path, query, out, stats));
+
+  ASSERT_EQ(stats.matches, 50u);
+  ASSERT_GT(stats.skipped_blocks, 0u);
+  ASSERT_THAT(out.str(), Not(HasSubstr("before")));
+
+  query.from_micros = numeric_limits<int64_t>::min();
+  query.to_micros = middle;
+  ASSERT_TRUE(query_log(path, query, out, stats));
+  ASSERT_EQ(stats.matches, 50u);
+}
+
+TEST(LogQuery, ThreadsGiveSameOutput)
+{
+  const string path{"query_threads.log"};
+  write_log(path);
+
+  LogQuery query;
+  query.pattern = "ok";
+  stringstream single;
+  stringstream multi;
+  LogQueryStats stats;
+
+  query.threads = 1;
+  ASSERT_TRUE(query_log(path, query, single, stats));
+  query.threads = 8;
+  ASSERT_TRUE(query_log(path, query, multi, stats));
+
+  ASSERT_EQ(stats.matches, 540u);
+  ASSERT_EQ(single.str(), multi.str());
+}
+
+TEST(LogQuery, FileWithoutIndex)
+{
+  const string path{"query_no_index.log"};
+  remove_log(path);
+  {
+    ofstream ofs{path};
+    Logger logger{ofs, LogSeverity::DEBUG};
+    logger.log(LogSeverity::INFO) << "plain file";
+    logger.log(LogSeverity::ERROR) << "plain error";
+  }
+
+  LogQuery query;
+  query.pattern = "plain";
+  stringstream out;
+  LogQueryStats stats;
+  ASSERT_TRUE(query_log(path, query, out, stats));
+  ASSERT_EQ(out.str(), "[INFO ] plain file\n[ERROR] plain error\n");
+
+  query.min_severity = LogSeverity::ERROR;
+  ASSERT_TRUE(query_log(path, query, out, stats));
+  ASSERT_EQ(stats.matches, 1u);
+
+  ASSERT_FALSE(query_log("missing_file.log", query, out, stats));
+}
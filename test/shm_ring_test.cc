@@ -0,0 +1,321 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "logger.hh"
+#include "shm_ring.hh"
+
+using namespace testing;
+using namespace cc;
+using namespace std;
+
+namespace {
+
+string ring_name(const string &test)
+{
+  return "/cc_logger_" + test + "_" + to_string(::getpid());
+}
+
+vector<string> lines(const string &text)
+{
+  vector<string> result;
+  istringstream iss{text};
+  string line;
+  while (getline(iss, line)) {
+    result.push_back(line);
+  }
+  return result;
+}
+
+ShmRingOptions ring_options(size_t producers, size_t slots, size_t slot_size,
+  chrono::milliseconds stall_timeout)
+{
+  ShmRingOptions options;
+  options.producers = producers;
+  options.slots = slots;
+  options.slot_size = slot_size;
+  options.stall_timeout = stall_timeout;
+  return options;
+}
+
+// Runs the function in a child process and waits for it
+template<typename F>
+void run_child(F f)
+{
+  const pid_t pid = ::fork();
+  if (pid == 0) {
+    f();
+    ::_exit(0);
+  }
+  ASSERT_GT(pid, 0);
+  int status = 0;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+}
+
+} //namespace
+
+TEST(ShmRing, SingleProcess)
+{
+  const string name = ring_name("single");
+  stringstream out;
+  ShmLogCollector collector{name, out};
+  ASSERT_TRUE(collector.is_open());
+
+  ShmLogStream shm_log{name};
+  ASSERT_TRUE(shm_log.is_open());
+  Logger logger{shm_log, LogSeverity::DEBUG};
+  logger.log(LogSeverity::INFO) << "first " << 1;
+  logger.log(LogSeverity::ERROR) << "second";
+  logger.log(LogSeverity::TRACE) << "filtered";
+
+  ASSERT_EQ(collector.collect(), 2u);
+  ASSERT_EQ(out.str(), "[INFO ] first 1\n[ERROR] second\n");
+}
+
+TEST(ShmRing, OrderAcrossProducers)
+{
+  const string name = ring_name("order");
+  stringstream out;
+  ShmLogCollector collector{name, out};
+
+  ShmLogStream a{name};
+  ShmLogStream b{name};
+  for (int i = 0; i < 100; ++i) {
+    (i % 3 == 0 ? b : a) << "line " << i << endl;
+  }
+
+  ASSERT_EQ(collector.collect(), 100u);
+  const auto result = lines(out.str());
+  ASSERT_EQ(result.size(), 100u);
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_EQ(result[i], "line " + to_string(i));
+  }
+}
+
+TEST(ShmRing, HeldUntilPredecessorCommitted)
+{
+  const string name = ring_name("held");
+  stringstream out;
+  ShmLogCollector collector{name, out};
+
+  ShmLogRing slow{name, ShmRingMode::ATTACH};
+  ShmLogRing fast{name, ShmRingMode::ATTACH};
+  ASSERT_TRUE(slow.attach_producer());
+  ASSERT_TRUE(fast.attach_producer());
+
+  size_t capacity = 0;
+  char *record = slow.begin_record(capacity);
+  ASSERT_NE(record, nullptr);
+  ASSERT_EQ(capacity, ShmRingOptions{}.slot_size);
+  ASSERT_TRUE(fast.write_record("later", 5));
+
+  // The record of the fast producer has a higher number than the one being written
+  ASSERT_EQ(collector.collect(), 0u);
+
+  memcpy(record, "earlier", 7);
+  slow.commit_record(7);
+  ASSERT_EQ(collector.collect(), 2u);
+  ASSERT_EQ(out.str(), "earlier\nlater\n");
+}
+
+TEST(ShmRing, MultiProcess)
+{
+  const string name = ring_name("multi");
+  stringstream out;
+  {
+    // Room for all the lines, so nothing is dropped however the collector is scheduled
+    ShmLogCollector collector{name, out, ring_options(8, 512, 128, chrono::milliseconds{1000})};
+    collector.start(chrono::milliseconds{1});
+
+    vector<pid_t> children;
+    for (int w = 0; w < 4; ++w) {
+      const pid_t pid = ::fork();
+      if (pid == 0) {
+        ShmLogStream shm_log{name};
+        Logger logger{shm_log, LogSeverity::DEBUG};
+        for (int i = 0; i < 500; ++i) {
+          logger.log(LogSeverity::INFO) << "worker " << w << " line " << i;
+        }
+        ::_exit(shm_log.dropped() == 0 ? 0 : 1);
+      }
+      ASSERT_GT(pid, 0);
+      children.push_back(pid);
+    }
+    for (auto pid: children) {
+      int status = 0;
+      ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+      ASSERT_TRUE(WIFEXITED(status));
+      ASSERT_EQ(WEXITSTATUS(status), 0);
+    }
+  }
+
+  const auto result = lines(out.str());
+  ASSERT_EQ(result.size(), 2000u);
+  vector<int> next(4, 0);
+  for (const auto &line: result) {
+    int w = -1;
+    int i = -1;
+    ASSERT_EQ(sscanf(line.c_str(), "[INFO ] worker %d line %d", &w, &i), 2) << line;
+    ASSERT_EQ(i, next[w]) << line;
+    ++next[w];
+  }
+}
+
+TEST(ShmRing, ProducerDiesMidRecord)
+{
+  const string name = ring_name("crash");
+  stringstream out;
+  ShmLogCollector collector{name, out, ring_options(2, 16, 64, chrono::milliseconds{60000})};
+
+  run_child([&]() {
+    ShmLogRing ring{name, ShmRingMode::ATTACH};
+    ring.attach_producer();
+    ring.write_record("before crash", 12);
+    size_t capacity = 0;
+    char *record = ring.begin_record(capacity);
+    memcpy(record, "never committed", 15);
+    // Dies without committing nor detaching
+    ::_exit(0);
+  });
+
+  ShmLogStream shm_log{name};
+  shm_log << "after crash" << endl;
+
+  ASSERT_EQ(collector.collect(), 2u);
+  ASSERT_EQ(out.str(), "before crash\nafter crash\n");
+
+  // The region of the dead producer was freed, so both regions can be claimed again
+  ShmLogStream other{name};
+  ASSERT_TRUE(other.is_open());
+}
+
+TEST(ShmRing, StalledProducer)
+{
+  const string name = ring_name("stall");
+  stringstream out;
+  ShmLogCollector collector{name, out, ring_options(4, 16, 64, chrono::milliseconds{20})};
+
+  ShmLogRing stalled{name, ShmRingMode::ATTACH};
+  ASSERT_TRUE(stalled.attach_producer());
+  size_t capacity = 0;
+  ASSERT_NE(stalled.begin_record(capacity), nullptr);
+
+  ShmLogStream shm_log{name};
+  shm_log << "not blocked forever" << endl;
+  ASSERT_EQ(collector.collect(), 0u);
+  this_thread::sleep_for(chrono::milliseconds{30});
+  ASSERT_EQ(collector.collect(), 1u);
+  ASSERT_EQ(out.str(), "not blocked forever\n");
+}
+
+TEST(ShmRing, ForkedStreamGetsOwnRegion)
+{
+  const string name = ring_name("fork");
+  stringstream out;
+  ShmLogCollector collector{name, out};
+
+  ShmLogStream shm_log{name};
+  shm_log << "parent" << endl;
+  run_child([&]() {
+    shm_log << "child" << endl;
+  });
+  shm_log << "parent again" << endl;
+
+  ASSERT_EQ(collector.collect(), 3u);
+  ASSERT_EQ(out.str(), "parent\nchild\nparent again\n");
+}
+
+TEST(ShmRing, DropsWhenFull)
+{
+  const string name = ring_name("full");
+  stringstream out;
+  ShmLogCollector collector{name, out, ring_options(1, 4, 16, chrono::milliseconds{1000})};
+
+  ShmLogStream shm_log{name};
+  for (int i = 0; i < 10; ++i) {
+    shm_log << "record " << i << endl;
+  }
+  ASSERT_EQ(shm_log.dropped(), 6u);
+  ASSERT_EQ(shm_log.truncated(), 0u);
+
+  ASSERT_EQ(collector.collect(), 4u);
+  ASSERT_EQ(out.str(), "record 0\nrecord 1\nrecord 2\nrecord 3\n");
+}
+
+TEST(ShmRing, TruncationIsMarked)
+{
+  const string name = ring_name("truncated");
+  stringstream out;
+  ShmLogCollector collector{name, out, ring_options(2, 4, 32, chrono::milliseconds{1000})};
+
+  ShmLogStream shm_log{name};
+  shm_log << "fits" << endl;
+  shm_log << string(100, 'x') << endl;
+  ASSERT_EQ(shm_log.truncated(), 1u);
+  ASSERT_EQ(shm_log.dropped(), 0u);
+
+  ASSERT_EQ(collector.collect(), 2u);
+  // The marker keeps the record within the slot size
+  ASSERT_THAT(lines(out.str()), ElementsAre("fits", string(17, 'x') + "... (100 bytes)"));
+
+  // Slots too small for the length
+  const string tiny_name = ring_name("tiny");
+  stringstream tiny_out;
+  ShmLogCollector tiny_collector{tiny_name, tiny_out, ring_options(1, 4, 8,
+    chrono::milliseconds{1000})};
+  ShmLogRing tiny{tiny_name, ShmRingMode::ATTACH};
+  ASSERT_TRUE(tiny.write_record("0123456789", 10));
+  ASSERT_TRUE(tiny.is_producer());
+  ASSERT_EQ(tiny.truncated(), 1u);
+  ASSERT_EQ(tiny_collector.collect(), 1u);
+  ASSERT_EQ(tiny_out.str(), "01234...\n");
+}
+
+TEST(ShmRing, RetriesClaimingRegion)
+{
+  const string name = ring_name("retry");
+  stringstream out;
+  ShmLogCollector collector{name, out, ring_options(1, 4, 32, chrono::milliseconds{1000})};
+
+  unique_ptr<ShmLogStream> first{new ShmLogStream{name}};
+  *first << "first" << endl;
+
+  // Only one producer region. The segment is attached, but the lines are dropped
+  ShmLogStream second{name};
+  ASSERT_TRUE(second.is_open());
+  second << "lost" << endl;
+  ASSERT_EQ(second.dropped(), 1u);
+
+  // Freed region, claimed on the next line
+  first.reset();
+  second << "second" << endl;
+  ASSERT_EQ(second.dropped(), 1u);
+
+  ASSERT_EQ(collector.collect(), 2u);
+  ASSERT_EQ(out.str(), "first\nsecond\n");
+}
+
+TEST(ShmRing, NoSegment)
+{
+  ShmLogStream shm_log{ring_name("missing")};
+  ASSERT_FALSE(shm_log.is_open());
+  ASSERT_TRUE(shm_log.fail());
+}
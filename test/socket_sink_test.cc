@@ -0,0 +1,358 @@
+/*********************************************************************
+Copyright (c) 2023, Claudio Costagliola Fiedler
+All rights reserved.
+
+This source code is licensed under the BSD-style license found in the
+LICENSE file in the root directory of this source tree.
+**********************************************************************/
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "logger.hh"
+#include "socket_sink.hh"
+
+using namespace testing;
+using namespace cc;
+using namespace std;
+
+// In-process stand-in for the log collector
+class Receiver {
+public:
+  Receiver(int domain, int type): m_fd{::socket(domain, type, 0)}, m_path{} {}
+  ~Receiver() {
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+    if (!m_path.empty()) {
+      ::unlink(m_path.c_str());
+    }
+  }
+
+  string bind_unix(const string &name) {
+    m_path = "/tmp/cc_logger_" + name + "_" + to_string(::getpid()) + ".sock";
+    ::unlink(m_path.c_str());
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, m_path.c_str(), sizeof(addr.sun_path) - 1);
+    EXPECT_EQ(::bind(m_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    return m_path;
+  }
+
+  string bind_udp() {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    EXPECT_EQ(::bind(m_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)), 0);
+    socklen_t len = sizeof(addr);
+    ::getsockname(m_fd, reinterpret_cast<sockaddr *>(&addr), &len);
+    return "127.0.0.1:" + to_string(ntohs(addr.sin_port));
+  }
+
+  vector<string> receive_all(int fd = -1) {
+    vector<string> messages;
+    char buf[65536];
+    for (;;) {
+      const ssize_t n = ::recv(fd < 0 ? m_fd : fd, buf, sizeof(buf), MSG_DONTWAIT);
+      if (n <= 0) {
+        break;
+      }
+      messages.emplace_back(buf, n);
+    }
+    return messages;
+  }
+
+  int fd() const { return m_fd; }
+
+private:
+  int m_fd;
+  string m_path;
+};
+
+TEST(SocketSink, UnixDatagramBatching)
+{
+  Receiver receiver{AF_UNIX, SOCK_DGRAM};
+  const string path = receiver.bind_unix("dgram");
+
+  SocketSinkOptions options;
+  options.batch_size = 4;
+  options.max_delay = chrono::hours{1};
+  SocketStream sink{SocketKind::UNIX_DGRAM, path, options};
+  ASSERT_TRUE(sink.is_open());
+
+  Logger logger{sink, LogSeverity::DEBUG};
+  logger.log(LogSeverity::INFO) << "line " << 1;
+  logger.log(LogSeverity::INFO) << "line " << 2;
+  logger.log(LogSeverity::INFO) << "line " << 3;
+
+  ASSERT_EQ(sink.pending(), 3u);
+  ASSERT_TRUE(receiver.receive_all().empty());
+
+  logger.log(LogSeverity::WARN) << "line " << 4;
+
+  ASSERT_EQ(sink.pending(), 0u);
+  ASSERT_EQ(sink.sent(), 4u);
+  ASSERT_THAT(receiver.receive_all(), ElementsAre("[INFO ] line 1", "[INFO ] line 2",
+    "[INFO ] line 3", "[WARN ] line 4"));
+}
+
+TEST(SocketSink, MaxDelay)
+{
+  Receiver receiver{AF_UNIX, SOCK_DGRAM};
+  const string path = receiver.bind_unix("delay");
+
+  SocketSinkOptions options;
+  options.batch_size = 100;
+  options.max_delay = chrono::milliseconds{0};
+  SocketStream sink{SocketKind::UNIX_DGRAM, path, options};
+
+  Logger logger{sink, LogSeverity::DEBUG};
+  logger.log(LogSeverity::INFO) << "sent on flush";
+
+  ASSERT_THAT(receiver.receive_all(), ElementsAre("[INFO ] sent on flush"));
+}
+
+TEST(SocketSink, DeadlineWithoutFurtherWrites)
+{
+  Receiver receiver{AF_UNIX, SOCK_DGRAM};
+  const string path = receiver.bind_unix("deadline");
+
+  SocketSinkOptions options;
+  options.batch_size = 100;
+  options.max_delay = chrono::milliseconds{20};
+  SocketStream sink{SocketKind::UNIX_DGRAM, path, options};
+
+  Logger logger{sink, LogSeverity::DEBUG};
+  logger.log(LogSeverity::INFO) << "lone line";
+
+  // Nothing else is written, the background thread sends it
+  const auto give_up = chrono::steady_clock::now() + chrono::seconds{5};
+  while ((sink.sent() == 0) && (chrono::steady_clock::now() < give_up)) {
+    this_thread::sleep_for(chrono::milliseconds{5});
+  }
+  ASSERT_EQ(sink.pending(), 0u);
+  ASSERT_THAT(receiver.receive_all(), ElementsAre("[INFO ] lone line"));
+}
+
+TEST(SocketSink, ErrorsSentAtOnce)
+{
+  Receiver receiver{AF_UNIX, SOCK_DGRAM};
+  const string path = receiver.bind_unix("error");
+
+  SocketSinkOptions options;
+  options.batch_size = 100;
+  options.max_delay = chrono::hours{1};
+  SocketStream sink{SocketKind::UNIX_DGRAM, path, options};
+
+  Logger logger{sink, LogSeverity::DEBUG};
+  logger.log(LogSeverity::WARN) << "before";
+  ASSERT_EQ(sink.pending(), 1u);
+  logger.log(LogSeverity::FATAL) << "dying";
+
+  ASSERT_EQ(sink.pending(), 0u);
+  ASSERT_EQ(sink.sent(), 2u);
+  ASSERT_THAT(receiver.receive_all(), ElementsAre("[WARN ] before", "[FATAL] dying"));
+}
+
+TEST(SocketSink, Udp)
+{
+  Receiver receiver{AF_INET, SOCK_DGRAM};
+  const string address = receiver.bind_udp();
+
+  {
+    SocketSinkOptions options;
+    options.max_delay = chrono::hours{1};
+    SocketStream sink{SocketKind::UDP, address, options};
+    ASSERT_TRUE(sink.is_open());
+
+    Logger logger{sink, LogSeverity::DEBUG};
+    logger.log(LogSeverity::DEBUG) << "over udp " << 2.5;
+    logger.log(LogSeverity::INFO) << "second";
+    ASSERT_EQ(sink.sent(), 0u);
+  }
+
+  ASSERT_THAT(receiver.receive_all(), ElementsAre("[DEBUG] over udp 2.5", "[INFO ] second"));
+}
+
+TEST(SocketSink, Rfc5424OverUnixStream)
+{
+  Receiver receiver{AF_UNIX, SOCK_STREAM};
+  const string path = receiver.bind_unix("stream");
+  ASSERT_EQ(::listen(receiver.fd(), 1), 0);
+
+  SocketSinkOptions options;
+  options.framing = SocketFraming::RFC5424;
+  options.app_name = "tester";
+  options.facility = 16;
+  SocketStream sink{SocketKind::UNIX_STREAM, path, options};
+  ASSERT_TRUE(sink.is_open());
+  const int conn = ::accept(receiver.fd(), nullptr, nullptr);
+  ASSERT_GE(conn, 0);
+
+  Logger logger{sink, LogSeverity::DEBUG};
+  logger.log(LogSeverity::ERROR) << "disk full";
+  logger.log(LogSeverity::INFO) << "recovered";
+  sink.send_pending();
+
+  string stream;
+  for (const auto &chunk: receiver.receive_all(conn)) {
+    stream += chunk;
+  }
+  ::close(conn);
+
+  // Octet counting: "LEN SP MSG"
+  vector<string> messages;
+  string::size_type pos = 0;
+  while (pos < stream.size()) {
+    const string::size_type sp = stream.find(' ', pos);
+    ASSERT_NE(sp, string::npos);
+    const size_t len = stoul(stream.substr(pos, sp - pos));
+    messages.push_back(stream.substr(sp + 1, len));
+    pos = sp + 1 + len;
+  }
+
+  ASSERT_EQ(messages.size(), 2u);
+  ASSERT_THAT(messages[0], StartsWith("<131>1 "));
+  ASSERT_THAT(messages[0], HasSubstr(" tester " + to_string(::getpid()) + " - - disk full"));
+  ASSERT_THAT(messages[0], EndsWith("- - disk full"));
+  ASSERT_THAT(messages[1], StartsWith("<134>1 "));
+  ASSERT_THAT(messages[1], EndsWith("- - recovered"));
+}
+
+TEST(SocketSink, DropsWhenCollectorLags)
+{
+  Receiver receiver{AF_UNIX, SOCK_DGRAM};
+  const string path = receiver.bind_unix("lag");
+
+  SocketSinkOptions options;
+  options.batch_size = 8;
+  options.max_pending = 32;
+  const int total = 5000;
+
+  SocketStream sink{SocketKind::UNIX_DGRAM, path, options};
+  Logger logger{sink, LogSeverity::DEBUG};
+  // Nobody reads the receiver, so its queue fills up and sends would block
+  for (int i = 0; i < total; ++i) {
+    logger.log(LogSeverity::INFO) << "record " << i;
+  }
+
+  ASSERT_GT(sink.dropped(), 0u);
+  ASSERT_LE(sink.pending(), options.max_pending);
+  ASSERT_EQ(sink.sent() + sink.dropped() + sink.pending(), static_cast<uint64_t>(total));
+  ASSERT_EQ(receiver.receive_all().size(), sink.sent());
+}
+
+TEST(SocketSink, CollectorRestarted)
+{
+  unique_ptr<Receiver> receiver{new Receiver{AF_UNIX, SOCK_DGRAM}};
+  const string path = receiver->bind_unix("restart");
+
+  SocketSinkOptions options;
+  options.batch_size = 1;
+  SocketStream sink{SocketKind::UNIX_DGRAM, path, options};
+  Logger logger{sink, LogSeverity::DEBUG};
+  logger.log(LogSeverity::INFO) << "before";
+  ASSERT_THAT(receiver->receive_all(), ElementsAre("[INFO ] before"));
+
+  // The old socket is refused, the sink connects to the new one
+  receiver.reset();
+  receiver.reset(new Receiver{AF_UNIX, SOCK_DGRAM});
+  ASSERT_EQ(receiver->bind_unix("restart"), path);
+  logger.log(LogSeverity::INFO) << "after";
+
+  ASSERT_TRUE(sink.is_open());
+  ASSERT_EQ(sink.sent(), 2u);
+  ASSERT_EQ(sink.dropped(), 0u);
+  ASSERT_THAT(receiver->receive_all(), ElementsAre("[INFO ] after"));
+}
+
+TEST(SocketSink, StreamCollectorRestarted)
+{
+  unique_ptr<Receiver> receiver{new Receiver{AF_UNIX, SOCK_STREAM}};
+  const string path = receiver->bind_unix("stream_restart");
+  ASSERT_EQ(::listen(receiver->fd(), 1), 0);
+
+  SocketSinkOptions options;
+  options.batch_size = 1;
+  SocketStream sink{SocketKind::UNIX_STREAM, path, options};
+  int conn = ::accept(receiver->fd(), nullptr, nullptr);
+  ASSERT_GE(conn, 0);
+  Logger logger{sink, LogSeverity::DEBUG};
+  logger.log(LogSeverity::INFO) << "one";
+  ASSERT_THAT(receiver->receive_all(conn), ElementsAre("[INFO ] one\n"));
+  ::close(conn);
+
+  receiver.reset();
+  receiver.reset(new Receiver{AF_UNIX, SOCK_STREAM});
+  ASSERT_EQ(receiver->bind_unix("stream_restart"), path);
+  ASSERT_EQ(::listen(receiver->fd(), 1), 0);
+  logger.log(LogSeverity::INFO) << "two";
+
+  conn = ::accept(receiver->fd(), nullptr, nullptr);
+  ASSERT_GE(conn, 0);
+  ASSERT_THAT(receiver->receive_all(conn), ElementsAre("[INFO ] two\n"));
+  ::close(conn);
+  ASSERT_EQ(sink.sent(), 2u);
+  ASSERT_EQ(sink.dropped(), 0u);
+}
+
+TEST(SocketSink, CollectorStartsLate)
+{
+  const string path = "/tmp/cc_logger_late_" + to_string(::getpid()) + ".sock";
+  ::unlink(path.c_str());
+
+  SocketSinkOptions options;
+  options.max_delay = chrono::milliseconds{10};
+  options.reconnect_delay = chrono::milliseconds{5};
+  SocketStream sink{SocketKind::UNIX_DGRAM, path, options};
+  ASSERT_FALSE(sink.is_open());
+  ASSERT_FALSE(sink.fail());
+
+  Logger logger{sink, LogSeverity::DEBUG};
+  logger.log(LogSeverity::INFO) << "early";
+  ASSERT_EQ(sink.pending(), 1u);
+
+  Receiver receiver{AF_UNIX, SOCK_DGRAM};
+  ASSERT_EQ(receiver.bind_unix("late"), path);
+  const auto give_up = chrono::steady_clock::now() + chrono::seconds{5};
+  while ((sink.sent() == 0) && (chrono::steady_clock::now() < give_up)) {
+    this_thread::sleep_for(chrono::milliseconds{5});
+  }
+
+  ASSERT_TRUE(sink.is_open());
+  ASSERT_EQ(sink.dropped(), 0u);
+  ASSERT_THAT(receiver.receive_all(), ElementsAre("[INFO ] early"));
+}
+
+TEST(SocketSink, NoCollector)
+{
+  SocketSinkOptions options;
+  options.max_pending = 4;
+  SocketStream sink{SocketKind::UNIX_DGRAM, "/tmp/cc_logger_missing_collector.sock", options};
+
+  // The stream stays usable, the lines wait for the collector up to max_pending
+  ASSERT_FALSE(sink.is_open());
+  ASSERT_FALSE(sink.fail());
+
+  Logger logger{sink, LogSeverity::DEBUG};
+  for (int i = 0; i < 10; ++i) {
+    logger.log(LogSeverity::ERROR) << "lost " << i;
+  }
+  ASSERT_EQ(sink.sent(), 0u);
+  ASSERT_EQ(sink.pending(), 4u);
+  ASSERT_EQ(sink.dropped(), 6u);
+}